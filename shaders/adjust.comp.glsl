@@ -0,0 +1,72 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Non-destructive adjustments, in two stages so changing only the later one reuses the earlier:
+//  mode 0: tone    - exposure, contrast, levels, curve; per pixel, textures[sourceIndex] -> result
+//  mode 1: sharpen - unsharp mask over 3x3, textures[sourceIndex] (a tone result) -> result
+// Inputs are sampled through sRGB views and come in linear, result is an UNORM view of an image
+// sampled as sRGB later, so it is encoded here.
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+layout(set = 1, binding = 0, rgba8) uniform writeonly image2D result;
+layout(set = 1, binding = 1) readonly buffer Curve {
+    float curve[256];   // output for inputs 0, 1/255 .. 1
+};
+
+layout(push_constant) uniform Params {
+    uint sourceIndex;
+    uint mode;
+    float exposure;     // stops
+    float contrast;     // slope around mid grey
+    float black;        // levels: input mapped to 0 and 1, then gamma
+    float white;
+    float gamma;
+    float sharpen;      // unsharp mask amount
+} p;
+
+const float MID_GREY = 0.18;
+
+vec3 encodeSRGB(vec3 c) {
+    c = clamp(c, 0.0, 1.0);
+    return mix(c * 12.92, 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055, step(vec3(0.0031308), c));
+}
+
+float applyCurve(float x) {
+    float position = clamp(x, 0.0, 1.0) * 255.0;
+    int i = min(int(position), 254);
+    return mix(curve[i], curve[i + 1], position - float(i));
+}
+
+vec3 tone(vec3 c) {
+    c *= exp2(p.exposure);
+    c = MID_GREY * pow(max(c, vec3(0.0)) / MID_GREY, vec3(p.contrast));
+    c = clamp((c - p.black) / max(p.white - p.black, 1e-5), 0.0, 1.0);
+    c = pow(c, vec3(1.0 / p.gamma));
+    return vec3(applyCurve(c.r), applyCurve(c.g), applyCurve(c.b));
+}
+
+void main() {
+    ivec2 extent = textureSize(textures[p.sourceIndex], 0);
+    ivec2 xy = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(xy, extent))) return;
+
+    vec4 texel = texelFetch(textures[p.sourceIndex], xy, 0);
+    vec3 color;
+    if (p.mode == 0u) {
+        color = tone(texel.rgb);
+    } else {
+        vec3 blur = vec3(0.0);
+        for (int y = -1; y <= 1; y++) {
+            for (int x = -1; x <= 1; x++) {
+                ivec2 at = clamp(xy + ivec2(x, y), ivec2(0), extent - 1);
+                float w = (x == 0 ? 2.0 : 1.0) * (y == 0 ? 2.0 : 1.0);
+                blur += w * texelFetch(textures[p.sourceIndex], at, 0).rgb;
+            }
+        }
+        blur /= 16.0;
+        color = texel.rgb + p.sharpen * (texel.rgb - blur);
+    }
+    imageStore(result, xy, vec4(encodeSRGB(color), texel.a));
+}
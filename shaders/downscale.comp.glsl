@@ -0,0 +1,95 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// One axis of a separable downscale. A workgroup produces 64 consecutive outputs of one line,
+// the source span their taps cover is loaded into shared memory once and reused by all of them.
+//  pass 0: horizontal, textures[sourceIndex] -> intermediate
+//  pass 1: vertical,   intermediate          -> result
+
+layout(local_size_x = 64) in;
+
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+layout(set = 1, binding = 0, rgba16f) uniform image2D intermediate;
+layout(set = 1, binding = 1, rgba16f) uniform image2D result;
+
+layout(push_constant) uniform Params {
+    ivec2 srcExtent;
+    ivec2 dstExtent;
+    uint sourceIndex;
+    uint pass;
+    uint filterType;    // 0 - box, 1 - Lanczos3
+} p;
+
+const int TILE = 64;
+// 16 KiB, the smallest maxComputeSharedMemorySize a device may have
+const int SHARED_TEXELS = 1024;
+const float PI = 3.14159265359;
+
+shared vec4 tile[SHARED_TEXELS];
+
+float sinc(float x) {
+    if (abs(x) < 1e-5) return 1.0;
+    x *= PI;
+    return sin(x) / x;
+}
+
+// x in output pixels from the output pixel's center
+float weight(float x) {
+    if (p.filterType == 0u) {
+        return abs(x) <= 0.5 ? 1.0 : 0.0;
+    }
+    return abs(x) < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+}
+
+vec4 load(int s, int line, int srcLength) {
+    s = clamp(s, 0, srcLength - 1);
+    if (p.pass == 0u) {
+        return texelFetch(textures[p.sourceIndex], ivec2(s, line), 0);
+    }
+    return imageLoad(intermediate, ivec2(line, s));
+}
+
+void main() {
+    int srcLength = p.pass == 0u ? p.srcExtent.x : p.srcExtent.y;
+    int dstLength = p.pass == 0u ? p.dstExtent.x : p.dstExtent.y;
+    int line = int(gl_WorkGroupID.y);
+    int first = int(gl_WorkGroupID.x) * TILE;
+    int o = first + int(gl_LocalInvocationID.x);
+
+    // source texels per output texel, the filter is stretched by it so every source texel counts
+    float scale = float(srcLength) / float(dstLength);
+    float radius = (p.filterType == 0u ? 0.5 : 3.0) * scale;
+
+    int spanStart = int(floor((float(first) + 0.5) * scale - radius));
+    int spanEnd = int(ceil((float(first + TILE - 1) + 0.5) * scale + radius));
+    int spanCount = min(spanEnd - spanStart + 1, SHARED_TEXELS);
+    for (int i = int(gl_LocalInvocationID.x); i < spanCount; i += TILE) {
+        tile[i] = load(spanStart + i, line, srcLength);
+    }
+    barrier();
+
+    if (o >= dstLength) return;
+
+    float center = (float(o) + 0.5) * scale;
+    int tapStart = int(floor(center - radius));
+    int tapEnd = int(ceil(center + radius));
+    vec4 sum = vec4(0.0);
+    float weightSum = 0.0;
+    for (int s = tapStart; s <= tapEnd; s++) {
+        float w = weight((float(s) + 0.5 - center) / scale);
+        if (w == 0.0) continue;
+        // extreme ratios overflow the tile, the rest of the taps go to memory directly
+        int t = s - spanStart;
+        vec4 texel = t < spanCount ? tile[t] : load(s, line, srcLength);
+        sum += w * texel;
+        weightSum += w;
+    }
+    // Lanczos lobes may ring below zero
+    vec4 color = max(sum / weightSum, vec4(0.0));
+
+    if (p.pass == 0u) {
+        imageStore(intermediate, ivec2(o, line), color);
+    } else {
+        imageStore(result, ivec2(line, o), color);
+    }
+}
@@ -0,0 +1,88 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_vote : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
+
+// R, G, B and luma histograms of textures[sourceIndex] plus per channel min and max, over the
+// display-encoded (sRGB) values. Every workgroup walks a grid-strided share of the image into its
+// own bins in shared memory and adds the non-empty ones to the global bins once at the end, so the
+// global atomics grow with the workgroup count and not with the pixel count. Subgroups fold
+// min/max, and runs of one bin (flat areas) turn into a single shared atomic.
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+layout(set = 1, binding = 0) buffer Result {
+    uint bins[4 * 256];     // channel * 256 + bin
+    uint minBits[4];        // floatBitsToUint, ordered like the floats for values >= 0
+    uint maxBits[4];
+} result;
+
+layout(push_constant) uniform Params {
+    uint sourceIndex;
+} p;
+
+const uint BINS = 256u;
+const uint CHANNELS = 4u;
+const uint INVOCATIONS = 256u;
+
+shared uint localBins[CHANNELS * BINS];
+
+vec3 encodeSRGB(vec3 c) {
+    c = clamp(c, 0.0, 1.0);
+    return mix(c * 12.92, 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055, step(vec3(0.0031308), c));
+}
+
+void count(uint slot) {
+    if (subgroupAllEqual(slot)) {
+        uint active = subgroupAdd(1u);
+        if (subgroupElect()) {
+            atomicAdd(localBins[slot], active);
+        }
+    } else {
+        atomicAdd(localBins[slot], 1u);
+    }
+}
+
+void main() {
+    for (uint i = gl_LocalInvocationIndex; i < CHANNELS * BINS; i += INVOCATIONS) {
+        localBins[i] = 0u;
+    }
+    barrier();
+
+    uvec2 extent = uvec2(textureSize(textures[p.sourceIndex], 0));
+    uvec2 stride = gl_NumWorkGroups.xy * gl_WorkGroupSize.xy;
+    // neutral for invocations that get no pixel
+    vec4 lo = vec4(1.0);
+    vec4 hi = vec4(0.0);
+    for (uint y = gl_GlobalInvocationID.y; y < extent.y; y += stride.y) {
+        for (uint x = gl_GlobalInvocationID.x; x < extent.x; x += stride.x) {
+            vec3 c = encodeSRGB(texelFetch(textures[p.sourceIndex], ivec2(x, y), 0).rgb);
+            vec4 v = vec4(c, dot(c, vec3(0.2126, 0.7152, 0.0722)));
+            lo = min(lo, v);
+            hi = max(hi, v);
+            uvec4 bin = min(uvec4(v * 255.0 + 0.5), uvec4(BINS - 1u));
+            for (uint channel = 0u; channel < CHANNELS; channel++) {
+                count(channel * BINS + bin[channel]);
+            }
+        }
+    }
+
+    lo = subgroupMin(lo);
+    hi = subgroupMax(hi);
+    if (subgroupElect()) {
+        for (uint channel = 0u; channel < CHANNELS; channel++) {
+            atomicMin(result.minBits[channel], floatBitsToUint(lo[channel]));
+            atomicMax(result.maxBits[channel], floatBitsToUint(hi[channel]));
+        }
+    }
+
+    barrier();
+    for (uint i = gl_LocalInvocationIndex; i < CHANNELS * BINS; i += INVOCATIONS) {
+        uint binCount = localBins[i];
+        if (binCount != 0u) {
+            atomicAdd(result.bins[i], binCount);
+        }
+    }
+}
@@ -0,0 +1,19 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(set = 0, binding = 1) uniform sampler2DArray textureArrays[];
+
+layout(push_constant) uniform PushConstants {
+    vec2 viewScale;
+    vec2 viewOffset;
+    uint textureIndex;
+} pc;
+
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) flat in uint fragLayer;
+
+layout (location = 0) out vec4 outColor;
+
+void main() {
+    outColor = texture(textureArrays[pc.textureIndex], vec3(fragTexCoord, float(fragLayer)));
+}
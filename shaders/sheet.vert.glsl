@@ -0,0 +1,26 @@
+#version 450
+
+// unit quad, one instance per thumbnail
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 inTexCoord;
+
+layout(location = 2) in vec4 instanceRect;     // xy - top left, zw - size, NDC
+layout(location = 3) in vec2 instanceUvScale;   // thumbnail rect on its atlas page
+layout(location = 4) in uint instanceLayer;
+layout(location = 5) in vec2 instanceUvOffset;
+
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) flat out uint fragLayer;
+
+layout(push_constant) uniform PushConstants {
+    vec2 viewScale;
+    vec2 viewOffset;
+    uint textureIndex;
+} pc;
+
+void main() {
+    vec2 cell = instanceRect.xy + position * instanceRect.zw;
+    gl_Position = vec4(cell * pc.viewScale + pc.viewOffset, 0.0, 1.0);
+    fragTexCoord = instanceUvOffset + inTexCoord * instanceUvScale;
+    fragLayer = instanceLayer;
+}
@@ -1,11 +1,18 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout (location = 0) out vec4 outColor;
+layout(set = 0, binding = 0) uniform sampler2D textures[];
 
-vec2 imageSize = vec2(1000.0, 1000.0);
+layout(push_constant) uniform PushConstants {
+    vec2 viewScale;
+    vec2 viewOffset;
+    uint textureIndex;
+} pc;
 
-void main() {
-    vec2 uv = gl_FragCoord.xy / imageSize;
-    outColor = vec4(uv, 0.0, 1.0);
+layout(location = 0) in vec2 fragTexCoord;
 
+layout (location = 0) out vec4 outColor;
+
+void main() {
+    outColor = texture(textures[pc.textureIndex], fragTexCoord);
 }
@@ -5,6 +5,13 @@ layout(location = 1) in vec2 inTexCoord;
 
 layout(location = 0) out vec2 fragTexCoord;
 
+layout(push_constant) uniform PushConstants {
+    vec2 viewScale;
+    vec2 viewOffset;
+    uint textureIndex;
+} pc;
+
 void main() {
-    gl_Position = vec4(position, 0.0, 1.0);
+    gl_Position = vec4(position * pc.viewScale + pc.viewOffset, 0.0, 1.0);
+    fragTexCoord = inTexCoord;
 }
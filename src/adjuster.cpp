@@ -0,0 +1,572 @@
+#include "types.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <vulkan/vulkan_core.h>
+
+#include "adjust.comp.h" // present by CMake
+
+// Jobs go to Device::computeQueue, a compute-only family where the device has one, so they overlap
+// the frames instead of queueing between them. Completion is a timeline semaphore: the TimelineWaiter
+// blocks on it and wakes the window loop, poll() only reads its value, and the first graphics
+// submission after a result is picked up waits on it (Device::addGraphicsWait) to make the writes
+// visible. Images are CONCURRENT between the two families, so no ownership transfers are needed.
+
+// matches Params in shaders/adjust.comp.glsl
+struct AdjustParams {
+    uint32_t sourceIndex;
+    uint32_t mode;
+    float exposure;
+    float contrast;
+    float black;
+    float white;
+    float gamma;
+    float sharpen;
+};
+
+static const uint32_t ADJUST_TILE = 16;         // local_size_x/y of the shader
+static const uint32_t ADJUST_MAX_ENTRIES = 64;  // descriptor sets in the pool
+static const uint32_t CURVE_SIZE = 256;
+
+enum AdjustMode : uint32_t {
+    ADJUST_TONE = 0,
+    ADJUST_SHARPEN = 1,
+};
+
+// FNV-1a
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+static const uint64_t HASH_SEED = 14695981039346656037ull;
+
+bool Adjuster::isIdentity(const Params &params) {
+    Params identity{};
+    return params.exposure == identity.exposure && params.contrast == identity.contrast &&
+        params.black == identity.black && params.white == identity.white && params.gamma == identity.gamma &&
+        params.curve.empty() && params.sharpen == identity.sharpen;
+}
+
+bool Adjuster::parseCurve(const std::string &text, std::vector<float> &curve) {
+    std::vector<std::pair<float, float>> points = {};
+    std::stringstream stream(text);
+    std::string point;
+    while (std::getline(stream, point, ',')) {
+        float x, y;
+        if (2 != std::sscanf(point.c_str(), "%f:%f", &x, &y) || x < 0.0f || x > 1.0f) {
+            return false;
+        }
+        points.push_back({x, y});
+    }
+    if (points.empty()) {
+        return false;
+    }
+    std::sort(points.begin(), points.end());
+
+    curve.resize(CURVE_SIZE);
+    for (uint32_t i = 0; i < CURVE_SIZE; i++) {
+        float x = static_cast<float>(i) / (CURVE_SIZE - 1);
+        auto upper = std::lower_bound(
+            points.begin(), points.end(), x,
+            [](const std::pair<float, float> &point, float x) { return point.first < x; }
+        );
+        if (upper == points.begin()) {
+            curve[i] = upper->second;
+        } else if (upper == points.end()) {
+            curve[i] = points.back().second;
+        } else {
+            auto lower = upper - 1;
+            float t = (x - lower->first) / std::max(upper->first - lower->first, 1e-6f);
+            curve[i] = lower->second + t * (upper->second - lower->second);
+        }
+    }
+    return true;
+}
+
+// ########
+//  CREATE
+// ########
+
+void Adjuster::create() {
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (VK_SUCCESS != vkCreateDescriptorSetLayout(this->device->device, &layoutInfo, nullptr, &this->setLayout)) {
+        throw std::runtime_error("failed to create adjuster descriptor set layout!");
+    }
+
+    // one set per cache entry, freed on eviction
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0] = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, ADJUST_MAX_ENTRIES};
+    poolSizes[1] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, ADJUST_MAX_ENTRIES};
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    poolInfo.maxSets = ADJUST_MAX_ENTRIES;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    if (VK_SUCCESS != vkCreateDescriptorPool(this->device->device, &poolInfo, nullptr, &this->descriptorPool)) {
+        throw std::runtime_error("failed to create adjuster descriptor pool!");
+    }
+
+    // set 0 - the texture heap the inputs are read from, set 1 - output and curve
+    std::array<VkDescriptorSetLayout, 2> setLayouts = {this->textures->descriptorSetLayout, this->setLayout};
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(AdjustParams);
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (VK_SUCCESS != vkCreatePipelineLayout(this->device->device, &pipelineLayoutInfo, nullptr, &this->pipelineLayout)) {
+        throw std::runtime_error("failed to create adjuster pipeline layout!");
+    }
+
+    VkShaderModuleCreateInfo shaderCI{};
+    shaderCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderCI.codeSize = sizeof(adjustCompShaderCode);
+    shaderCI.pCode = adjustCompShaderCode;
+    if (VK_SUCCESS != vkCreateShaderModule(this->device->device, &shaderCI, nullptr, &this->shaderModule)) {
+        throw std::runtime_error("failed to create adjust shader module");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = this->shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = this->pipelineLayout;
+    if (VK_SUCCESS != vkCreateComputePipelines(this->device->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &this->pipeline)) {
+        throw std::runtime_error("failed to create adjust pipeline!");
+    }
+
+    VkCommandPoolCreateInfo commandPoolInfo{};
+    commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolInfo.queueFamilyIndex = this->device->queueFamilies.computeFamily;
+    commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (VK_SUCCESS != vkCreateCommandPool(this->device->device, &commandPoolInfo, nullptr, &this->commandPool)) {
+        throw std::runtime_error("failed to create adjuster command pool!");
+    }
+    VkCommandBufferAllocateInfo commandBufferInfo{};
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferInfo.commandPool = this->commandPool;
+    commandBufferInfo.commandBufferCount = 1;
+    if (VK_SUCCESS != vkAllocateCommandBuffers(this->device->device, &commandBufferInfo, &this->commandBuffer)) {
+        throw std::runtime_error("failed to allocate adjuster command buffer!");
+    }
+
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &timelineInfo;
+    if (VK_SUCCESS != vkCreateSemaphore(this->device->device, &semaphoreInfo, nullptr, &this->timeline)) {
+        throw std::runtime_error("failed to create adjuster timeline semaphore!");
+    }
+    this->timelineValue = 0;
+
+    // only written while no job runs, jobs run one at a time
+    this->device->createBuffer(
+        CURVE_SIZE * sizeof(float),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        this->curveBuffer,
+        this->curveMemory
+    );
+    vkMapMemory(this->device->device, this->curveMemory, 0, CURVE_SIZE * sizeof(float), 0, &this->curveData);
+}
+
+void Adjuster::destroy() {
+    vkDeviceWaitIdle(this->device->device);
+    if (nullptr != this->waiter) {
+        this->waiter->remove(this->timeline);
+    }
+    this->job = {};
+    this->current = nullptr;
+    while (!this->entries.empty()) {
+        destroyEntry(this->entries.back().get());
+    }
+    // idle, the retired entries can go now
+    this->device->collectRetired(true);
+
+    vkUnmapMemory(this->device->device, this->curveMemory);
+    vkDestroyBuffer(this->device->device, this->curveBuffer, nullptr);
+    vkFreeMemory(this->device->device, this->curveMemory, nullptr);
+    vkDestroySemaphore(this->device->device, this->timeline, nullptr);
+    vkDestroyCommandPool(this->device->device, this->commandPool, nullptr);
+    vkDestroyPipeline(this->device->device, this->pipeline, nullptr);
+    vkDestroyShaderModule(this->device->device, this->shaderModule, nullptr);
+    vkDestroyPipelineLayout(this->device->device, this->pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(this->device->device, this->descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(this->device->device, this->setLayout, nullptr);
+    this->curveData = nullptr;
+    this->curveBuffer = VK_NULL_HANDLE;
+    this->curveMemory = VK_NULL_HANDLE;
+    this->timeline = VK_NULL_HANDLE;
+    this->commandPool = VK_NULL_HANDLE;
+    this->commandBuffer = VK_NULL_HANDLE;
+    this->pipeline = VK_NULL_HANDLE;
+    this->shaderModule = VK_NULL_HANDLE;
+    this->pipelineLayout = VK_NULL_HANDLE;
+    this->descriptorPool = VK_NULL_HANDLE;
+    this->setLayout = VK_NULL_HANDLE;
+}
+
+// #########
+//  ENTRIES
+// #########
+
+Adjuster::Entry *Adjuster::find(uint64_t key) {
+    for (std::unique_ptr<Entry> &entry : this->entries) {
+        if (entry->key == key) {
+            entry->lastUse = ++this->useCounter;
+            return entry.get();
+        }
+    }
+    return nullptr;
+}
+
+// UNORM for imageStore (sRGB formats can't be storage images), sRGB view for sampling
+Adjuster::Entry *Adjuster::createEntry(uint64_t key) {
+    std::unique_ptr<Entry> entry = std::make_unique<Entry>();
+    entry->key = key;
+    entry->lastUse = ++this->useCounter;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {this->sourceExtent.width, this->sourceExtent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    this->device->setConcurrentSharing(imageInfo);
+    this->device->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, entry->image, entry->memory, &entry->size);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = entry->image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    if (VK_SUCCESS != vkCreateImageView(this->device->device, &viewInfo, nullptr, &entry->storageView)) {
+        throw std::runtime_error("failed to create adjusted image storage view!");
+    }
+    VkImageViewUsageCreateInfo sampledUsage{};
+    sampledUsage.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+    sampledUsage.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+    viewInfo.pNext = &sampledUsage;
+    viewInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+    if (VK_SUCCESS != vkCreateImageView(this->device->device, &viewInfo, nullptr, &entry->sampledView)) {
+        throw std::runtime_error("failed to create adjusted image sampled view!");
+    }
+    entry->textureIndex = this->textures->allocate(TextureHeap::BINDING_2D, entry->sampledView);
+
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = this->descriptorPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &this->setLayout;
+    if (VK_SUCCESS != vkAllocateDescriptorSets(this->device->device, &allocateInfo, &entry->descriptorSet)) {
+        throw std::runtime_error("failed to allocate adjuster descriptor set!");
+    }
+    VkDescriptorImageInfo storageInfo = {VK_NULL_HANDLE, entry->storageView, VK_IMAGE_LAYOUT_GENERAL};
+    VkDescriptorBufferInfo curveInfo = {this->curveBuffer, 0, VK_WHOLE_SIZE};
+    std::array<VkWriteDescriptorSet, 2> writes{};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = entry->descriptorSet;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[0].pImageInfo = &storageInfo;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = entry->descriptorSet;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[1].pBufferInfo = &curveInfo;
+    vkUpdateDescriptorSets(this->device->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+    this->entries.push_back(std::move(entry));
+    return this->entries.back().get();
+}
+
+// frames in flight may still sample a shown entry, the image and its heap slot are retired; the
+// compute work that wrote it is done, the descriptor set goes right away
+void Adjuster::destroyEntry(Entry *entry) {
+    vkFreeDescriptorSets(this->device->device, this->descriptorPool, 1, &entry->descriptorSet);
+    uint32_t textureIndex = entry->textureIndex;
+    VkImageView sampledView = entry->sampledView;
+    VkImageView storageView = entry->storageView;
+    VkImage image = entry->image;
+    VkDeviceMemory memory = entry->memory;
+    this->device->retire([this, textureIndex, sampledView, storageView, image, memory]() {
+        this->textures->release(TextureHeap::BINDING_2D, textureIndex);
+        vkDestroyImageView(this->device->device, sampledView, nullptr);
+        vkDestroyImageView(this->device->device, storageView, nullptr);
+        vkDestroyImage(this->device->device, image, nullptr);
+        vkFreeMemory(this->device->device, memory, nullptr);
+    });
+    this->entries.erase(std::find_if(
+        this->entries.begin(), this->entries.end(),
+        [entry](const std::unique_ptr<Entry> &e) { return e.get() == entry; }
+    ));
+}
+
+// least recently used first; what is shown or being written stays
+void Adjuster::evict(uint32_t reserve) {
+    VkDeviceSize total = 0;
+    for (std::unique_ptr<Entry> &entry : this->entries) {
+        total += entry->size;
+    }
+    while (total > this->cacheBudget || this->entries.size() + reserve > ADJUST_MAX_ENTRIES) {
+        Entry *victim = nullptr;
+        for (std::unique_ptr<Entry> &entry : this->entries) {
+            Entry *e = entry.get();
+            if (e == this->current || e == this->job.tone || e == this->job.result) continue;
+            if (nullptr == victim || e->lastUse < victim->lastUse) {
+                victim = e;
+            }
+        }
+        if (nullptr == victim) {
+            break;
+        }
+        if (victim->shown && this->releaseImage) {
+            // a histogram may still be reading it
+            this->releaseImage(victim->image);
+        }
+        total -= victim->size;
+        destroyEntry(victim);
+    }
+}
+
+// ######
+//  JOBS
+// ######
+
+void Adjuster::request(const Params &params) {
+    this->pending = params;
+    this->hasPending = true;
+    start();
+}
+
+void Adjuster::start() {
+    if (this->job.active || !this->hasPending) {
+        return;
+    }
+    Params params = this->pending;
+    this->hasPending = false;
+
+    if (isIdentity(params)) {
+        if (nullptr != this->current) {
+            this->current = nullptr;
+            this->changed = true;
+        }
+        return;
+    }
+
+    // room for the up to two entries this job creates
+    evict(2);
+
+    // the source is part of the key, a new image never hits an old entry
+    uint64_t toneKey = HASH_SEED;
+    toneKey = hashBytes(toneKey, &this->sourceImage, sizeof(this->sourceImage));
+    for (float value : {params.exposure, params.contrast, params.black, params.white, params.gamma}) {
+        toneKey = hashBytes(toneKey, &value, sizeof(value));
+    }
+    toneKey = hashBytes(toneKey, params.curve.data(), params.curve.size() * sizeof(float));
+    bool sharpen = params.sharpen != 0.0f;
+    uint64_t resultKey = sharpen ? hashBytes(toneKey, &params.sharpen, sizeof(float)) : toneKey;
+
+    Entry *result = find(resultKey);
+    if (nullptr != result) {
+        this->cacheHitCount++;
+        if (result != this->current) {
+            this->current = result;
+            this->changed = true;
+        }
+        return;
+    }
+    Entry *tone = find(toneKey);
+    bool toneCached = nullptr != tone;
+    if (toneCached) {
+        this->cacheHitCount++;
+    } else {
+        tone = createEntry(toneKey);
+    }
+    result = sharpen ? createEntry(resultKey) : tone;
+
+    if (!toneCached) {
+        float *curve = static_cast<float*>(this->curveData);
+        for (uint32_t i = 0; i < CURVE_SIZE; i++) {
+            curve[i] = params.curve.empty() ? static_cast<float>(i) / (CURVE_SIZE - 1) : params.curve[i];
+        }
+    }
+
+    AdjustParams pushParams{};
+    pushParams.exposure = params.exposure;
+    pushParams.contrast = params.contrast;
+    pushParams.black = params.black;
+    pushParams.white = params.white;
+    pushParams.gamma = params.gamma;
+    pushParams.sharpen = params.sharpen;
+    uint32_t groupsX = (this->sourceExtent.width + ADJUST_TILE - 1) / ADJUST_TILE;
+    uint32_t groupsY = (this->sourceExtent.height + ADJUST_TILE - 1) / ADJUST_TILE;
+    auto dispatch = [&](VkCommandBuffer commandBuffer, Entry *output, uint32_t mode, uint32_t inputIndex) {
+        pushParams.mode = mode;
+        pushParams.sourceIndex = inputIndex;
+        vkCmdBindDescriptorSets(
+            commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 1, 1, &output->descriptorSet, 0, nullptr
+        );
+        vkCmdPushConstants(
+            commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(AdjustParams), &pushParams
+        );
+        vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+    };
+
+    // results are left for compute reads, fragment stages don't exist on a compute-only queue;
+    // the layout is what graphics samples with, the semaphore wait covers its stages
+    RenderGraph adjustGraph{};
+    adjustGraph.device = this->device;
+    RenderGraph::ResourceId source = adjustGraph.importImage(
+        "source", this->sourceImage, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    );
+    RenderGraph::ResourceId toneImage = adjustGraph.importImage(
+        "tone", tone->image, tone->sampledView,
+        toneCached ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
+        RenderGraph::ACCESS_COMPUTE_SAMPLED_READ
+    );
+    if (!toneCached) {
+        adjustGraph.addPass(
+            "tone",
+            {{source, RenderGraph::ACCESS_COMPUTE_SAMPLED_READ}},
+            {{toneImage, RenderGraph::ACCESS_COMPUTE_STORAGE_WRITE}},
+            [&](VkCommandBuffer commandBuffer, RenderGraph &graph) {
+                dispatch(commandBuffer, tone, ADJUST_TONE, this->sourceIndex);
+            }
+        );
+    }
+    if (sharpen) {
+        RenderGraph::ResourceId resultImage = adjustGraph.importImage(
+            "sharpened", result->image, result->sampledView, VK_IMAGE_LAYOUT_UNDEFINED,
+            RenderGraph::ACCESS_COMPUTE_SAMPLED_READ
+        );
+        adjustGraph.addPass(
+            "sharpen",
+            {{toneImage, RenderGraph::ACCESS_COMPUTE_SAMPLED_READ}},
+            {{resultImage, RenderGraph::ACCESS_COMPUTE_STORAGE_WRITE}},
+            [&](VkCommandBuffer commandBuffer, RenderGraph &graph) {
+                dispatch(commandBuffer, result, ADJUST_SHARPEN, tone->textureIndex);
+            }
+        );
+    }
+
+    vkResetCommandBuffer(this->commandBuffer, 0);
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (VK_SUCCESS != vkBeginCommandBuffer(this->commandBuffer, &beginInfo)) {
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
+    vkCmdBindPipeline(this->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+    this->textures->bind(this->commandBuffer, this->pipelineLayout, VK_PIPELINE_BIND_POINT_COMPUTE);
+    adjustGraph.execute(this->commandBuffer);
+    if (VK_SUCCESS != vkEndCommandBuffer(this->commandBuffer)) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+    this->dispatchCount += (toneCached ? 0 : 1) + (sharpen ? 1 : 0);
+
+    // the source may have been uploaded by a graphics submission that is still pending or running
+    uint64_t uploadValue = this->device->flushDeferredGraphics();
+    VkPipelineStageFlags uploadStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    uint64_t signalValue = ++this->timelineValue;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = uploadValue != 0 ? 1 : 0;
+    timelineInfo.pWaitSemaphoreValues = &uploadValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = uploadValue != 0 ? 1 : 0;
+    submitInfo.pWaitSemaphores = &this->device->graphicsTimeline;
+    submitInfo.pWaitDstStageMask = &uploadStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &this->commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &this->timeline;
+    {
+        std::lock_guard<std::mutex> queueLock(this->device->queueMutex(this->device->computeQueue));
+        if (VK_SUCCESS != vkQueueSubmit(this->device->computeQueue, 1, &submitInfo, VK_NULL_HANDLE)) {
+            throw std::runtime_error("failed to submit adjust command buffer!");
+        }
+    }
+
+    this->job = {true, signalValue, tone, result};
+    evict(0);
+
+    if (this->notify && nullptr != this->waiter) {
+        this->waiter->add(this->timeline, signalValue, this->notify);
+    }
+}
+
+bool Adjuster::poll() {
+    if (this->job.active) {
+        uint64_t value = 0;
+        vkGetSemaphoreCounterValue(this->device->device, this->timeline, &value);
+        if (value >= this->job.timelineValue) {
+            this->device->addGraphicsWait(
+                this->timeline, this->job.timelineValue,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+            );
+            this->current = this->job.result;
+            this->job = {};
+            this->changed = true;
+            start();
+        }
+    }
+    bool changed = this->changed;
+    this->changed = false;
+    return changed;
+}
+
+void Adjuster::beforeSourceWrite() {
+    if (!this->job.active) return;
+    this->device->addGraphicsWait(this->timeline, this->job.timelineValue, VK_PIPELINE_STAGE_TRANSFER_BIT);
+}
+
+std::pair<VkImage, uint32_t> Adjuster::result() {
+    if (nullptr == this->current) {
+        return {this->sourceImage, this->sourceIndex};
+    }
+    this->current->shown = true;
+    return {this->current->image, this->current->textureIndex};
+}
@@ -0,0 +1,91 @@
+#include "types.hpp"
+#include <cstdint>
+#include <climits>
+
+// Skyline bottom-left packing: good enough for thumbnails of similar heights arriving in any
+// order, and an insert only walks the segments of a page, there is no free rect list to split.
+
+void AtlasPacker::reset(VkExtent2D pageExtent) {
+    this->pageExtent = pageExtent;
+    this->skylines.clear();
+    this->usedArea = 0;
+}
+
+int32_t AtlasPacker::fitAt(const std::vector<Segment> &skyline, size_t i, int32_t width, int32_t height) {
+    int32_t x = skyline[i].x;
+    if (x + width > static_cast<int32_t>(this->pageExtent.width)) {
+        return -1;
+    }
+    // resting on the highest segment below it
+    int32_t y = 0;
+    int32_t widthLeft = width;
+    for (size_t j = i; widthLeft > 0; j++) {
+        y = std::max(y, skyline[j].y);
+        if (y + height > static_cast<int32_t>(this->pageExtent.height)) {
+            return -1;
+        }
+        widthLeft -= skyline[j].width;
+    }
+    return y;
+}
+
+bool AtlasPacker::insertInto(std::vector<Segment> &skyline, int32_t width, int32_t height, VkOffset2D &offset) {
+    size_t best = SIZE_MAX;
+    int32_t bestBottom = INT32_MAX;
+    int32_t bestWidth = INT32_MAX;
+    for (size_t i = 0; i < skyline.size(); i++) {
+        int32_t y = this->fitAt(skyline, i, width, height);
+        if (y < 0) continue;
+        // closest to the top of the page, then the narrowest segment so wide ones stay free for wide rects
+        if (y + height < bestBottom || (y + height == bestBottom && skyline[i].width < bestWidth)) {
+            best = i;
+            bestBottom = y + height;
+            bestWidth = skyline[i].width;
+        }
+    }
+    if (best == SIZE_MAX) {
+        return false;
+    }
+    offset = {skyline[best].x, bestBottom - height};
+
+    skyline.insert(skyline.begin() + best, {offset.x, bestBottom, width});
+    // the segments under the new one are cut back or dropped
+    for (size_t i = best + 1; i < skyline.size(); i++) {
+        int32_t covered = skyline[i - 1].x + skyline[i - 1].width - skyline[i].x;
+        if (covered <= 0) break;
+        skyline[i].x += covered;
+        skyline[i].width -= covered;
+        if (skyline[i].width > 0) break;
+        skyline.erase(skyline.begin() + i);
+        i--;
+    }
+    for (size_t i = 0; i + 1 < skyline.size(); i++) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+            i--;
+        }
+    }
+    return true;
+}
+
+bool AtlasPacker::insert(VkExtent2D extent, Placement &placement) {
+    int32_t width = static_cast<int32_t>(extent.width + this->padding);
+    int32_t height = static_cast<int32_t>(extent.height + this->padding);
+    if (width > static_cast<int32_t>(this->pageExtent.width) ||
+        height > static_cast<int32_t>(this->pageExtent.height)) {
+        return false;
+    }
+    for (uint32_t page = 0; page < this->skylines.size(); page++) {
+        if (this->insertInto(this->skylines[page], width, height, placement.offset)) {
+            placement.page = page;
+            this->usedArea += static_cast<uint64_t>(extent.width) * extent.height;
+            return true;
+        }
+    }
+    this->skylines.push_back({{0, 0, static_cast<int32_t>(this->pageExtent.width)}});
+    this->insertInto(this->skylines.back(), width, height, placement.offset);
+    placement.page = this->pageCount() - 1;
+    this->usedArea += static_cast<uint64_t>(extent.width) * extent.height;
+    return true;
+}
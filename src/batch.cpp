@@ -0,0 +1,571 @@
+#include "types.hpp"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <vulkan/vulkan_core.h>
+
+// decode (jobs) -> staging ring -> GPU upload + downscale + readback (slot fence) -> encode (jobs)
+//
+// Every stage has its own queue, so while the GPU downscales slot i the recording thread fills
+// slot i+1, the decode jobs work ahead and the encode jobs write out what slot i-ringSize produced.
+
+// ##########
+//  DECODING
+// ##########
+
+// A decode job is submitted for every image taken, so only a bounded window of them is decoded
+// ahead of the GPU, and a job never waits for room in the queue while holding a worker.
+
+void BatchProcessor::submitDecode() {
+    size_t index = this->nextInput++;
+    {
+        std::lock_guard<std::mutex> lock(this->decodedMutex);
+        this->decodesRunning++;
+    }
+    this->jobs->submit([this, index]() { decode(index); });
+}
+
+void BatchProcessor::decode(size_t index) {
+    auto start = std::chrono::steady_clock::now();
+    Decoded image{};
+    int width = 0, height = 0, channels = 0;
+    image.index = index;
+    image.pixels = stbi_load(this->inputs[index].c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (nullptr != image.pixels) {
+        image.width = static_cast<uint32_t>(width);
+        image.height = static_cast<uint32_t>(height);
+    }
+    auto end = std::chrono::steady_clock::now();
+    this->decodeBusyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    if (nullptr == image.pixels) {
+        std::cerr << "failed to load " << this->inputs[index] << std::endl;
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->decodedMutex);
+        this->decoded.push(image);
+        this->decodesRunning--;
+    }
+    this->decodedAdded.notify_one();
+}
+
+// false - every input was taken; image.pixels is null for one that failed to decode
+bool BatchProcessor::popDecoded(Decoded &image) {
+    std::unique_lock<std::mutex> lock(this->decodedMutex);
+    this->decodedAdded.wait(lock, [this] { return !this->decoded.empty() || this->decodesRunning == 0; });
+    if (this->decoded.empty()) {
+        return false;
+    }
+    image = this->decoded.front();
+    this->decoded.pop();
+    lock.unlock();
+    if (this->nextInput < this->inputs.size()) {
+        submitDecode();
+    }
+    return true;
+}
+
+// ###############
+//  RING RESOURCES
+// ###############
+
+void BatchProcessor::create() {
+    this->slots.resize(this->ringSize);
+
+    std::vector<VkCommandBuffer> commandBuffers(this->ringSize);
+    VkCommandBufferAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandPool = this->device->commandPool;
+    allocateInfo.commandBufferCount = this->ringSize;
+    if (VK_SUCCESS != vkAllocateCommandBuffers(this->device->device, &allocateInfo, commandBuffers.data())) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    for (uint32_t i = 0; i < this->ringSize; i++) {
+        this->slots[i].commandBuffer = commandBuffers[i];
+        if (VK_SUCCESS != vkCreateFence(this->device->device, &fenceInfo, nullptr, &this->slots[i].fence)) {
+            throw std::runtime_error("failed to create batch fence!");
+        }
+    }
+
+    VkPhysicalDeviceProperties phdevProps;
+    vkGetPhysicalDeviceProperties(this->device->physicalDevice, &phdevProps);
+    if (phdevProps.limits.timestampComputeAndGraphics) {
+        this->timestampPeriod = phdevProps.limits.timestampPeriod;
+        VkQueryPoolCreateInfo queryInfo{};
+        queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryInfo.queryCount = 2 * this->ringSize;
+        if (VK_SUCCESS != vkCreateQueryPool(this->device->device, &queryInfo, nullptr, &this->timestamps)) {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+    }
+}
+
+void BatchProcessor::destroySlotImages(Slot &slot) {
+    vkDestroyImage(this->device->device, slot.srcImage, nullptr);
+    vkFreeMemory(this->device->device, slot.srcMemory, nullptr);
+    vkDestroyImage(this->device->device, slot.dstImage, nullptr);
+    vkFreeMemory(this->device->device, slot.dstMemory, nullptr);
+    slot.srcImage = VK_NULL_HANDLE;
+    slot.srcMemory = VK_NULL_HANDLE;
+    slot.dstImage = VK_NULL_HANDLE;
+    slot.dstMemory = VK_NULL_HANDLE;
+    slot.srcExtent = {0, 0};
+    slot.dstExtent = {0, 0};
+}
+
+void BatchProcessor::destroy() {
+    for (Slot &slot : this->slots) {
+        destroySlotImages(slot);
+        if (VK_NULL_HANDLE != slot.stagingBuffer) {
+            vkUnmapMemory(this->device->device, slot.stagingMemory);
+            vkDestroyBuffer(this->device->device, slot.stagingBuffer, nullptr);
+            vkFreeMemory(this->device->device, slot.stagingMemory, nullptr);
+        }
+        if (VK_NULL_HANDLE != slot.readbackBuffer) {
+            vkUnmapMemory(this->device->device, slot.readbackMemory);
+            vkDestroyBuffer(this->device->device, slot.readbackBuffer, nullptr);
+            vkFreeMemory(this->device->device, slot.readbackMemory, nullptr);
+        }
+        vkDestroyFence(this->device->device, slot.fence, nullptr);
+        vkFreeCommandBuffers(this->device->device, this->device->commandPool, 1, &slot.commandBuffer);
+    }
+    this->slots.clear();
+    if (VK_NULL_HANDLE != this->timestamps) {
+        vkDestroyQueryPool(this->device->device, this->timestamps, nullptr);
+        this->timestamps = VK_NULL_HANDLE;
+    }
+}
+
+void BatchProcessor::prepareSlot(Slot &slot, const Decoded &image) {
+    // output extent: fit into maxExtent keeping the aspect ratio, never upscale
+    double scale = std::min({
+        1.0,
+        static_cast<double>(this->maxExtent.width) / image.width,
+        static_cast<double>(this->maxExtent.height) / image.height
+    });
+    VkExtent2D dstExtent = {
+        std::max(1u, static_cast<uint32_t>(image.width * scale)),
+        std::max(1u, static_cast<uint32_t>(image.height * scale))
+    };
+
+    VkDeviceSize srcSize = static_cast<VkDeviceSize>(image.width) * image.height * 4;
+    if (srcSize > slot.stagingCapacity) {
+        if (VK_NULL_HANDLE != slot.stagingBuffer) {
+            vkUnmapMemory(this->device->device, slot.stagingMemory);
+            vkDestroyBuffer(this->device->device, slot.stagingBuffer, nullptr);
+            vkFreeMemory(this->device->device, slot.stagingMemory, nullptr);
+            slot.stagingBuffer = VK_NULL_HANDLE;
+            slot.stagingMemory = VK_NULL_HANDLE;
+            slot.stagingData = nullptr;
+            slot.stagingCapacity = 0;
+        }
+        this->device->createBuffer(
+            srcSize,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            slot.stagingBuffer,
+            slot.stagingMemory
+        );
+        vkMapMemory(this->device->device, slot.stagingMemory, 0, srcSize, 0, &slot.stagingData);
+        slot.stagingCapacity = srcSize;
+    }
+
+    VkDeviceSize dstSize = static_cast<VkDeviceSize>(dstExtent.width) * dstExtent.height * 4;
+    if (VK_NULL_HANDLE == this->targetImage && dstSize > slot.readbackCapacity) {
+        if (VK_NULL_HANDLE != slot.readbackBuffer) {
+            vkUnmapMemory(this->device->device, slot.readbackMemory);
+            vkDestroyBuffer(this->device->device, slot.readbackBuffer, nullptr);
+            vkFreeMemory(this->device->device, slot.readbackMemory, nullptr);
+            slot.readbackBuffer = VK_NULL_HANDLE;
+            slot.readbackMemory = VK_NULL_HANDLE;
+            slot.readbackData = nullptr;
+            slot.readbackCapacity = 0;
+        }
+        // cached memory makes the CPU reads of the result fast, not every device has it coherent
+        VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        if (this->device->hasMemoryType(
+                this->device->bufferMemoryTypes(dstSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+                properties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
+            properties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        }
+        this->device->createBuffer(
+            dstSize,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            properties,
+            slot.readbackBuffer,
+            slot.readbackMemory
+        );
+        vkMapMemory(this->device->device, slot.readbackMemory, 0, dstSize, 0, &slot.readbackData);
+        slot.readbackCapacity = dstSize;
+    }
+
+    // images are kept as long as consecutive inputs have the same size (the common case in a batch)
+    if (slot.srcExtent.width != image.width || slot.srcExtent.height != image.height ||
+        slot.dstExtent.width != dstExtent.width || slot.dstExtent.height != dstExtent.height) {
+        destroySlotImages(slot);
+
+        // halve on the GPU while the next level is still at least as big as the output,
+        // the last blit then never minifies by more than 2x (no aliasing)
+        uint32_t mipLevels = 1;
+        uint32_t w = image.width, h = image.height;
+        while (w / 2 >= dstExtent.width && h / 2 >= dstExtent.height) {
+            w /= 2;
+            h /= 2;
+            mipLevels++;
+        }
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = image.width;
+        imageInfo.extent.height = image.height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = mipLevels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.flags = 0;
+        this->device->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.srcImage, slot.srcMemory);
+
+        if (VK_NULL_HANDLE == this->targetImage) {
+            imageInfo.extent.width = dstExtent.width;
+            imageInfo.extent.height = dstExtent.height;
+            imageInfo.mipLevels = 1;
+            this->device->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.dstImage, slot.dstMemory);
+        }
+
+        slot.srcExtent = {image.width, image.height};
+        slot.dstExtent = dstExtent;
+        slot.mipLevels = mipLevels;
+    }
+
+    memcpy(slot.stagingData, image.pixels, srcSize);
+    slot.index = image.index;
+}
+
+// ###########
+//  RECORDING
+// ###########
+
+static void imageBarrier(
+    VkCommandBuffer commandBuffer,
+    VkImage image,
+    uint32_t baseMipLevel,
+    uint32_t levelCount,
+    VkImageLayout oldLayout,
+    VkImageLayout newLayout,
+    VkAccessFlags srcAccess,
+    VkAccessFlags dstAccess
+) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = baseMipLevel;
+    barrier.subresourceRange.levelCount = levelCount;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier
+    );
+}
+
+static void blit(
+    VkCommandBuffer commandBuffer,
+    VkImage src, uint32_t srcLevel, VkExtent2D srcExtent,
+    VkImage dst, uint32_t dstLevel, VkExtent2D dstExtent,
+    uint32_t dstLayer = 0,
+    VkOffset2D dstOffset = {0, 0}
+) {
+    VkImageBlit region{};
+    region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, srcLevel, 0, 1};
+    region.srcOffsets[1] = {static_cast<int32_t>(srcExtent.width), static_cast<int32_t>(srcExtent.height), 1};
+    region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, dstLevel, dstLayer, 1};
+    region.dstOffsets[0] = {dstOffset.x, dstOffset.y, 0};
+    region.dstOffsets[1] = {
+        dstOffset.x + static_cast<int32_t>(dstExtent.width), dstOffset.y + static_cast<int32_t>(dstExtent.height), 1
+    };
+    vkCmdBlitImage(
+        commandBuffer,
+        src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1, &region,
+        VK_FILTER_LINEAR
+    );
+}
+
+void BatchProcessor::recordSlot(Slot &slot) {
+    uint32_t slotId = static_cast<uint32_t>(&slot - this->slots.data());
+    VkCommandBuffer commandBuffer = slot.commandBuffer;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &beginInfo)) {
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
+    if (VK_NULL_HANDLE != this->timestamps) {
+        vkCmdResetQueryPool(commandBuffer, this->timestamps, 2 * slotId, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, this->timestamps, 2 * slotId);
+    }
+
+    // upload into mip 0, the same path Model uses for its texture
+    Model::recordTextureUpload(
+        commandBuffer,
+        slot.stagingBuffer,
+        slot.srcImage,
+        slot.srcExtent.width,
+        slot.srcExtent.height,
+        RenderGraph::ACCESS_TRANSFER_READ
+    );
+
+    // 2x reduction chain
+    VkExtent2D extent = slot.srcExtent;
+    for (uint32_t level = 1; level < slot.mipLevels; level++) {
+        VkExtent2D next = {extent.width / 2, extent.height / 2};
+        imageBarrier(
+            commandBuffer, slot.srcImage, level, 1,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            0, VK_ACCESS_TRANSFER_WRITE_BIT
+        );
+        blit(commandBuffer, slot.srcImage, level - 1, extent, slot.srcImage, level, next);
+        imageBarrier(
+            commandBuffer, slot.srcImage, level, 1,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT
+        );
+        extent = next;
+    }
+
+    // final resample to the output size
+    if (VK_NULL_HANDLE != this->targetImage) {
+        // layers (or atlas rects) are disjoint, slots in flight never write the same texels
+        blit(
+            commandBuffer, slot.srcImage, slot.mipLevels - 1, extent,
+            this->targetImage, 0, slot.dstExtent, slot.targetLayer, slot.targetOffset
+        );
+        if (VK_NULL_HANDLE != this->timestamps) {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->timestamps, 2 * slotId + 1);
+        }
+        if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+        return;
+    }
+    imageBarrier(
+        commandBuffer, slot.dstImage, 0, 1,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        0, VK_ACCESS_TRANSFER_WRITE_BIT
+    );
+    blit(commandBuffer, slot.srcImage, slot.mipLevels - 1, extent, slot.dstImage, 0, slot.dstExtent);
+    imageBarrier(
+        commandBuffer, slot.dstImage, 0, 1,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT
+    );
+
+    // readback
+    VkBufferImageCopy copyRegion{};
+    copyRegion.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    copyRegion.imageExtent = {slot.dstExtent.width, slot.dstExtent.height, 1};
+    vkCmdCopyImageToBuffer(
+        commandBuffer,
+        slot.dstImage,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        slot.readbackBuffer,
+        1,
+        &copyRegion
+    );
+
+    VkBufferMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.buffer = slot.readbackBuffer;
+    hostBarrier.offset = 0;
+    hostBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        0, nullptr,
+        1, &hostBarrier,
+        0, nullptr
+    );
+
+    if (VK_NULL_HANDLE != this->timestamps) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->timestamps, 2 * slotId + 1);
+    }
+    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+}
+
+void BatchProcessor::collectSlot(Slot &slot) {
+    uint32_t slotId = static_cast<uint32_t>(&slot - this->slots.data());
+    if (VK_NULL_HANDLE != this->timestamps) {
+        uint64_t ticks[2];
+        if (VK_SUCCESS == vkGetQueryPoolResults(
+            this->device->device, this->timestamps, 2 * slotId, 2,
+            sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT
+        )) {
+            this->gpuBusyNs += static_cast<uint64_t>((ticks[1] - ticks[0]) * this->timestampPeriod);
+        }
+    }
+    if (VK_NULL_HANDLE != this->targetImage) {
+        this->outputExtents[slot.index] = slot.dstExtent;
+        slot.inUse = false;
+        return;
+    }
+
+    ImageEncoder::Job job{};
+    job.path = outputPath(slot.index);
+    job.format = this->format;
+    job.width = slot.dstExtent.width;
+    job.height = slot.dstExtent.height;
+    job.pixels.resize(static_cast<size_t>(job.width) * job.height * 4);
+    memcpy(job.pixels.data(), slot.readbackData, job.pixels.size());
+    this->encoder->push(std::move(job));
+    slot.inUse = false;
+}
+
+std::string BatchProcessor::outputPath(size_t index) {
+    std::filesystem::path input(this->inputs[index]);
+    std::filesystem::path output(this->outputDir);
+    output /= input.stem().string() + ImageEncoder::extension(this->format);
+    return output.string();
+}
+
+// #####
+//  RUN
+// #####
+
+void BatchProcessor::run() {
+    using clock = std::chrono::steady_clock;
+    auto ns = [](clock::duration d) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+    };
+
+    bool encoding = VK_NULL_HANDLE == this->targetImage;
+    if (encoding) {
+        std::filesystem::create_directories(this->outputDir);
+        this->encoder->maxPending = 4 * this->ringSize;
+    } else {
+        this->outputExtents.assign(this->inputs.size(), {0, 0});
+    }
+
+    // enough decodes in flight to keep every worker busy, plus what the ring takes next
+    uint32_t workerCount = this->jobs->threadCount();
+    size_t window = std::min(this->inputs.size(), static_cast<size_t>(2 * this->ringSize + workerCount));
+    this->nextInput = 0;
+    this->decodesRunning = 0;
+
+    auto start = clock::now();
+    for (size_t i = 0; i < window; i++) {
+        submitDecode();
+    }
+
+    uint64_t recordNs = 0, fenceWaitNs = 0, starvedNs = 0;
+    size_t submitted = 0;
+    size_t next = 0;
+    while (true) {
+        Slot &slot = this->slots[next];
+        next = (next + 1) % this->slots.size();
+
+        if (slot.inUse) {
+            auto t0 = clock::now();
+            vkWaitForFences(this->device->device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+            auto t1 = clock::now();
+            fenceWaitNs += ns(t1 - t0);
+            collectSlot(slot);
+        }
+
+        auto t0 = clock::now();
+        Decoded image{};
+        bool more = popDecoded(image);
+        auto t1 = clock::now();
+        starvedNs += ns(t1 - t0);
+        if (!more) break;
+        if (nullptr == image.pixels) continue;
+
+        prepareSlot(slot, image);
+        stbi_image_free(image.pixels);
+        slot.targetLayer = static_cast<uint32_t>(slot.index);
+        slot.targetOffset = {0, 0};
+        if (VK_NULL_HANDLE != this->targetImage && this->placeOutput &&
+            !this->placeOutput(slot.index, slot.dstExtent, slot.targetLayer, slot.targetOffset)) {
+            continue;
+        }
+        recordSlot(slot);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &slot.commandBuffer;
+        vkResetFences(this->device->device, 1, &slot.fence);
+        if (VK_SUCCESS != vkQueueSubmit(this->device->graphicsQueue, 1, &submitInfo, slot.fence)) {
+            throw std::runtime_error("failed to submit batch command buffer!");
+        }
+        slot.inUse = true;
+        submitted++;
+        recordNs += ns(clock::now() - t1);
+    }
+
+    // drain the ring in submission order
+    for (size_t i = 0; i < this->slots.size(); i++) {
+        Slot &slot = this->slots[(next + i) % this->slots.size()];
+        if (!slot.inUse) continue;
+        auto t0 = clock::now();
+        vkWaitForFences(this->device->device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+        fenceWaitNs += ns(clock::now() - t0);
+        collectSlot(slot);
+    }
+    uint32_t encoderCount = encoding ? this->encoder->threadCount() : 0;
+    if (encoding) {
+        // run_batch created the encoder and destroys it
+        this->encoder->flush();
+    }
+    auto end = clock::now();
+
+    double wall = std::chrono::duration<double>(end - start).count();
+    double wallNs = wall * 1e9;
+    std::cout << "batch: " << submitted << "/" << this->inputs.size() << " images in " << wall << " s, "
+              << submitted / wall << " images/s" << std::endl;
+    std::cout << "  decode  (" << workerCount << " workers): "
+              << 100.0 * this->decodeBusyNs / (wallNs * std::max(1u, workerCount)) << "% busy" << std::endl;
+    std::cout << "  upload  (1 thread):  " << 100.0 * recordNs / wallNs << "% busy, "
+              << 100.0 * starvedNs / wallNs << "% waiting for decode, "
+              << 100.0 * fenceWaitNs / wallNs << "% waiting for GPU" << std::endl;
+    if (VK_NULL_HANDLE != this->timestamps) {
+        std::cout << "  gpu:                 " << 100.0 * this->gpuBusyNs / wallNs << "% busy" << std::endl;
+    }
+    if (encoding) {
+        std::cout << "  encode  (" << encoderCount << " workers): "
+                  << 100.0 * this->encoder->busyNs / (wallNs * encoderCount) << "% busy" << std::endl;
+    }
+}
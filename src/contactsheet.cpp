@@ -0,0 +1,405 @@
+#include "types.hpp"
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <vulkan/vulkan_core.h>
+
+// Every thumbnail is a rect on a page of one texture array atlas and an instance of one unit quad.
+// The instance buffer holds where each cell goes and which page and rect it samples, so the grid
+// costs one bind and one vkCmdDraw however many images it has, and relayouting it only rewrites the
+// instance buffer. Thumbnails are packed as they come out of the batch (AtlasPacker), so dozens of
+// small ones share a page instead of each taking a layer of the biggest thumbnail's size; the array
+// grows by doubling when a page more is needed and is trimmed to the pages used at the end.
+// The array itself is one TextureHeap slot (textureIndex), registered by the owner.
+
+// ###########
+//  RESOURCES
+// ###########
+
+void ContactSheet::createArray(uint32_t layers, VkImage &image, VkDeviceMemory &memory, VkImageView &view) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = this->pageExtent.width;
+    imageInfo.extent.height = this->pageExtent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = layers;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.flags = 0;
+    this->device->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    viewInfo.format = imageInfo.format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = layers;
+    if (VK_SUCCESS != vkCreateImageView(this->device->device, &viewInfo, nullptr, &view)) {
+        throw std::runtime_error("failed to create texture array view!");
+    }
+}
+
+void ContactSheet::create() {
+    VkPhysicalDeviceProperties phdevProps;
+    vkGetPhysicalDeviceProperties(this->device->physicalDevice, &phdevProps);
+    // a page holds at least one thumbnail
+    uint32_t maxDimension = phdevProps.limits.maxImageDimension2D;
+    this->pageExtent.width = std::min(std::max(this->pageExtent.width, this->cellExtent.width + 1), maxDimension);
+    this->pageExtent.height = std::min(std::max(this->pageExtent.height, this->cellExtent.height + 1), maxDimension);
+    this->cellExtent.width = std::min(this->cellExtent.width, this->pageExtent.width - 1);
+    this->cellExtent.height = std::min(this->cellExtent.height, this->pageExtent.height - 1);
+    this->maxLayerCount = phdevProps.limits.maxImageArrayLayers;
+    this->atlas.reset(this->pageExtent);
+
+    this->layerCount = 1;
+    createArray(this->layerCount, this->textureImage, this->textureMemory, this->textureView);
+
+    // unit quad as a strip, shared by every instance
+    const Model::Vertex quad[] = {
+        {{0.0f, 0.0f}, {0.0f, 0.0f}},
+        {{0.0f, 1.0f}, {0.0f, 1.0f}},
+        {{1.0f, 0.0f}, {1.0f, 0.0f}},
+        {{1.0f, 1.0f}, {1.0f, 1.0f}},
+    };
+    this->device->createBuffer(
+        sizeof(quad),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        this->vertexBuffer,
+        this->vertexBufferMemory
+    );
+    void *data;
+    vkMapMemory(this->device->device, this->vertexBufferMemory, 0, sizeof(quad), 0, &data);
+    memcpy(data, quad, sizeof(quad));
+    vkUnmapMemory(this->device->device, this->vertexBufferMemory);
+
+    VkDeviceSize instanceSize = sizeof(Instance) * std::max<size_t>(1, this->paths.size());
+    this->device->createBuffer(
+        instanceSize,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        this->instanceBuffer,
+        this->instanceBufferMemory
+    );
+    vkMapMemory(this->device->device, this->instanceBufferMemory, 0, instanceSize, 0, &this->instanceData);
+    this->instanceCount = 0;
+}
+
+void ContactSheet::destroy() {
+    vkUnmapMemory(this->device->device, this->instanceBufferMemory);
+    vkDestroyBuffer(this->device->device, this->instanceBuffer, nullptr);
+    vkFreeMemory(this->device->device, this->instanceBufferMemory, nullptr);
+    vkDestroyBuffer(this->device->device, this->vertexBuffer, nullptr);
+    vkFreeMemory(this->device->device, this->vertexBufferMemory, nullptr);
+
+    vkDestroyImageView(this->device->device, this->textureView, nullptr);
+    vkDestroyImage(this->device->device, this->textureImage, nullptr);
+    vkFreeMemory(this->device->device, this->textureMemory, nullptr);
+
+    this->instanceData = nullptr;
+    this->instanceCount = 0;
+    this->thumbnailExtents.clear();
+    this->placements.clear();
+}
+
+void ContactSheet::resizeArray(uint32_t layers) {
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    createArray(layers, image, memory, view);
+    uint32_t copied = std::min(layers, this->layerCount);
+
+    // the old array may still be written by batch blits in flight; the barrier's first scope
+    // reaches back to them (same queue, earlier submissions)
+    VkCommandBuffer commandBuffer = this->device->beginSingleTimeCommands();
+    std::array<VkImageMemoryBarrier2, 2> barriers{};
+    barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barriers[0].srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    barriers[0].srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barriers[0].dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[0].image = this->textureImage;
+    barriers[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, this->layerCount};
+    barriers[1] = barriers[0];
+    barriers[1].srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+    barriers[1].srcAccessMask = VK_ACCESS_2_NONE;
+    barriers[1].dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].image = image;
+    barriers[1].subresourceRange.layerCount = layers;
+    VkDependencyInfo dependency{};
+    dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency.imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size());
+    dependency.pImageMemoryBarriers = barriers.data();
+    vkCmdPipelineBarrier2(commandBuffer, &dependency);
+
+    VkImageCopy region{};
+    region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, copied};
+    region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, copied};
+    region.extent = {this->pageExtent.width, this->pageExtent.height, 1};
+    vkCmdCopyImage(
+        commandBuffer,
+        this->textureImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1, &region
+    );
+    if (layers > copied) {
+        // pages to come start out transparent, the gaps between thumbnails stay so
+        VkClearColorValue clearColor = {{0.0f, 0.0f, 0.0f, 0.0f}};
+        VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, copied, layers - copied};
+        vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &clearColor, 1, &range);
+    }
+    // the batch blits into the new array without barriers of its own (later submissions, same
+    // queue), after the copy and the clear
+    VkImageMemoryBarrier2 written{};
+    written.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    written.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    written.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    written.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    written.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    written.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    written.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    written.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    written.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    written.image = image;
+    written.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, layers};
+    dependency.imageMemoryBarrierCount = 1;
+    dependency.pImageMemoryBarriers = &written;
+    vkCmdPipelineBarrier2(commandBuffer, &dependency);
+    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+
+    // not waited for; the old array goes once the copy is done, and with it the blits in flight
+    // that were submitted before it
+    this->device->submitGraphics({commandBuffer}, {}, {}, VK_NULL_HANDLE);
+    this->device->retire([device = this->device, commandBuffer,
+                          oldView = this->textureView, oldImage = this->textureImage, oldMemory = this->textureMemory]() {
+        vkFreeCommandBuffers(device->device, device->commandPool, 1, &commandBuffer);
+        vkDestroyImageView(device->device, oldView, nullptr);
+        vkDestroyImage(device->device, oldImage, nullptr);
+        vkFreeMemory(device->device, oldMemory, nullptr);
+    });
+    this->textureImage = image;
+    this->textureMemory = memory;
+    this->textureView = view;
+    this->layerCount = layers;
+}
+
+// ############
+//  THUMBNAILS
+// ############
+
+void ContactSheet::loadThumbnails(JobSystem *jobs) {
+    // the gaps between thumbnails stay transparent
+    VkCommandBuffer commandBuffer = this->device->beginSingleTimeCommands();
+    RenderGraph clearGraph{};
+    RenderGraph::ResourceId array = clearGraph.importImage(
+        "thumbnails", this->textureImage, this->textureView, VK_IMAGE_LAYOUT_UNDEFINED,
+        RenderGraph::ACCESS_TRANSFER_WRITE
+    );
+    clearGraph.addPass(
+        "clear",
+        {},
+        {{array, RenderGraph::ACCESS_TRANSFER_WRITE}},
+        [&](VkCommandBuffer commandBuffer, RenderGraph &graph) {
+            VkClearColorValue clearColor = {{0.0f, 0.0f, 0.0f, 0.0f}};
+            VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, this->layerCount};
+            vkCmdClearColorImage(
+                commandBuffer, graph.getImage(array), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &clearColor, 1, &range
+            );
+        }
+    );
+    clearGraph.execute(commandBuffer);
+    this->device->endSingleTimeCommands(commandBuffer);
+
+    // decode + GPU downscale straight into the atlas, placed in the order they finish decoding
+    BatchProcessor batch{};
+    batch.device = this->device;
+    batch.inputs = this->paths;
+    batch.maxExtent = this->cellExtent;
+    batch.jobs = jobs;
+    batch.targetImage = this->textureImage;
+    this->placements.assign(this->paths.size(), {});
+    uint32_t skipped = 0;
+    batch.placeOutput = [this, &batch, &skipped](size_t index, VkExtent2D extent, uint32_t &layer, VkOffset2D &offset) {
+        AtlasPacker::Placement placement{};
+        if (!this->atlas.insert(extent, placement) || placement.page >= this->maxLayerCount) {
+            skipped++;
+            return false;
+        }
+        if (placement.page >= this->layerCount) {
+            resizeArray(std::min(this->maxLayerCount, std::max(placement.page + 1, 2 * this->layerCount)));
+            batch.targetImage = this->textureImage;
+        }
+        this->placements[index] = placement;
+        layer = placement.page;
+        offset = placement.offset;
+        return true;
+    };
+    batch.create();
+    batch.run();
+    batch.destroy();
+    this->thumbnailExtents = std::move(batch.outputExtents);
+    if (skipped > 0) {
+        std::cerr << "contact sheet: " << skipped << " of " << this->paths.size()
+                  << " images did not fit into the texture array" << std::endl;
+    }
+    if (this->atlas.pageCount() < this->layerCount) {
+        // doubling leaves up to half the pages empty
+        resizeArray(std::max(1u, this->atlas.pageCount()));
+    }
+    if (debug) {
+        double used = static_cast<double>(this->atlas.usedArea) /
+            (static_cast<double>(this->pageExtent.width) * this->pageExtent.height * this->layerCount);
+        std::cout << "contact sheet: " << this->paths.size() - skipped << " thumbnails on " << this->layerCount
+                  << " pages of " << this->pageExtent.width << "x" << this->pageExtent.height << ", "
+                  << 100.0 * used << "% of the texels used" << std::endl;
+    }
+
+    commandBuffer = this->device->beginSingleTimeCommands();
+    RenderGraph readyGraph{};
+    readyGraph.importImage(
+        "thumbnails", this->textureImage, this->textureView, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        RenderGraph::ACCESS_FRAGMENT_SAMPLED_READ
+    );
+    readyGraph.execute(commandBuffer);
+    this->device->endSingleTimeCommands(commandBuffer);
+}
+
+// ########
+//  LAYOUT
+// ########
+
+void ContactSheet::layout(VkExtent2D viewExtent) {
+    std::vector<uint32_t> shown = {};
+    for (uint32_t index = 0; index < this->thumbnailExtents.size(); index++) {
+        if (this->thumbnailExtents[index].width != 0) {
+            shown.push_back(index);
+        }
+    }
+    this->instanceCount = static_cast<uint32_t>(shown.size());
+    if (shown.empty()) {
+        return;
+    }
+
+    // the column count that gives the biggest cells, O(n) but only on relayout
+    float viewWidth = static_cast<float>(viewExtent.width);
+    float viewHeight = static_cast<float>(viewExtent.height);
+    float cellAspect = static_cast<float>(this->cellExtent.width) / this->cellExtent.height;
+    uint32_t columns = 1;
+    float cellWidth = 0.0f;
+    for (uint32_t c = 1; c <= shown.size(); c++) {
+        uint32_t rows = static_cast<uint32_t>((shown.size() + c - 1) / c);
+        float width = std::min(viewWidth / c, viewHeight / rows * cellAspect);
+        if (width > cellWidth) {
+            cellWidth = width;
+            columns = c;
+        }
+    }
+    float cellHeight = cellWidth / cellAspect;
+    uint32_t rows = static_cast<uint32_t>((shown.size() + columns - 1) / columns);
+    float originX = 0.5f * (viewWidth - columns * cellWidth);
+    float originY = 0.5f * (viewHeight - rows * cellHeight);
+
+    Instance *instances = static_cast<Instance*>(this->instanceData);
+    glm::vec2 page = {static_cast<float>(this->pageExtent.width), static_cast<float>(this->pageExtent.height)};
+    for (uint32_t i = 0; i < shown.size(); i++) {
+        VkExtent2D thumbnail = this->thumbnailExtents[shown[i]];
+        const AtlasPacker::Placement &placement = this->placements[shown[i]];
+        glm::vec2 cellFraction = {
+            static_cast<float>(thumbnail.width) / this->cellExtent.width,
+            static_cast<float>(thumbnail.height) / this->cellExtent.height
+        };
+        // thumbnails keep their aspect ratio, centered in the cell
+        float width = cellWidth * (1.0f - this->spacing) * cellFraction.x;
+        float height = cellHeight * (1.0f - this->spacing) * cellFraction.y;
+        float x = originX + (i % columns) * cellWidth + 0.5f * (cellWidth - width);
+        float y = originY + (i / columns) * cellHeight + 0.5f * (cellHeight - height);
+
+        instances[i].rect = {
+            2.0f * x / viewWidth - 1.0f,
+            2.0f * y / viewHeight - 1.0f,
+            2.0f * width / viewWidth,
+            2.0f * height / viewHeight
+        };
+        instances[i].uvScale = glm::vec2(thumbnail.width, thumbnail.height) / page;
+        instances[i].layer = placement.page;
+        instances[i].uvOffset = glm::vec2(placement.offset.x, placement.offset.y) / page;
+    }
+}
+
+// ##########
+//  DRAWING
+// ##########
+
+std::vector<VkVertexInputBindingDescription> ContactSheet::getVertexBindingDescriptions() {
+    std::vector<VkVertexInputBindingDescription> bindingDescriptions(2);
+    bindingDescriptions[0].binding = 0;
+    bindingDescriptions[0].stride = sizeof(Model::Vertex);
+    bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    bindingDescriptions[1].binding = 1;
+    bindingDescriptions[1].stride = sizeof(Instance);
+    bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    return bindingDescriptions;
+}
+
+std::vector<VkVertexInputAttributeDescription> ContactSheet::getVertexAttributeDescriptions() {
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions = Model::getVertexAttributeDescriptions();
+    attributeDescriptions.resize(6);
+    attributeDescriptions[2].binding = 1;
+    attributeDescriptions[2].location = 2;
+    attributeDescriptions[2].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    attributeDescriptions[2].offset = offsetof(Instance, rect);
+
+    attributeDescriptions[3].binding = 1;
+    attributeDescriptions[3].location = 3;
+    attributeDescriptions[3].format = VK_FORMAT_R32G32_SFLOAT;
+    attributeDescriptions[3].offset = offsetof(Instance, uvScale);
+
+    attributeDescriptions[4].binding = 1;
+    attributeDescriptions[4].location = 4;
+    attributeDescriptions[4].format = VK_FORMAT_R32_UINT;
+    attributeDescriptions[4].offset = offsetof(Instance, layer);
+
+    attributeDescriptions[5].binding = 1;
+    attributeDescriptions[5].location = 5;
+    attributeDescriptions[5].format = VK_FORMAT_R32G32_SFLOAT;
+    attributeDescriptions[5].offset = offsetof(Instance, uvOffset);
+    return attributeDescriptions;
+}
+
+void ContactSheet::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, PushConstants &pushConstants) {
+    VkBuffer buffers[] = {this->vertexBuffer, this->instanceBuffer};
+    VkDeviceSize offsets[] = {0, 0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 2, buffers, offsets);
+
+    pushConstants.textureIndex = this->textureIndex;
+    vkCmdPushConstants(
+        commandBuffer,
+        pipelineLayout,
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        0,
+        sizeof(PushConstants),
+        &pushConstants
+    );
+}
+
+void ContactSheet::draw(VkCommandBuffer commandBuffer) {
+    vkCmdDraw(commandBuffer, 4, this->instanceCount, 0, 0);
+}
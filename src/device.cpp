@@ -1,12 +1,11 @@
 #include "types.hpp"
 #include <array>
 #include <cstdint>
+#include <cstddef>
 #include <vulkan/vulkan_core.h>
 
 
-bool Device::areDeviceExtensionsSupported(VkPhysicalDevice phdev) {
-    
-    std::vector<const char*> &requiredExtensions = this->deviceExtensions;
+bool Device::areDeviceExtensionsSupported(VkPhysicalDevice phdev, const std::vector<const char*> &requiredExtensions) {
     
     std::vector<VkExtensionProperties> availableExtensions;
     uint32_t availableExtensionsCount;
@@ -18,7 +17,7 @@ bool Device::areDeviceExtensionsSupported(VkPhysicalDevice phdev) {
         throw std::runtime_error("failed to enumerate phdev extensions");
     }
     
-    bool supported = false;
+    bool supported = true;
     for (const char* str : requiredExtensions) {
         supported=false;
         for (const VkExtensionProperties prop : availableExtensions) {
@@ -32,10 +31,42 @@ bool Device::areDeviceExtensionsSupported(VkPhysicalDevice phdev) {
     return supported;
 }
 
-bool Device::areDeviceFeaturesSupported(VkPhysicalDevice phdev) {
+// every VkBool32 in [begin, end) set in required is set in supported as well
+static bool areFeaturesSubset(const void *required, const void *supported, size_t begin, size_t end) {
+    const VkBool32 *req = reinterpret_cast<const VkBool32*>(static_cast<const char*>(required) + begin);
+    const VkBool32 *sup = reinterpret_cast<const VkBool32*>(static_cast<const char*>(supported) + begin);
+    for (size_t i = 0; i < (end - begin) / sizeof(VkBool32); i++) {
+        if (req[i] && !sup[i]) return false;
+    }
     return true;
 }
 
+bool Device::areDeviceFeaturesSupported(VkPhysicalDevice phdev) {
+    VkPhysicalDeviceProperties phdevProps;
+    vkGetPhysicalDeviceProperties(phdev, &phdevProps);
+    if (phdevProps.apiVersion < VK_API_VERSION_1_3) {
+        return false;
+    }
+
+    VkPhysicalDeviceVulkan13Features supported13{};
+    supported13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    supported12.pNext = &supported13;
+    VkPhysicalDeviceFeatures2 supported{};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(phdev, &supported);
+
+    return areFeaturesSubset(&this->enabledFeatures.features, &supported.features, 0, sizeof(VkPhysicalDeviceFeatures)) &&
+        areFeaturesSubset(&this->enabledFeatures12, &supported12,
+            offsetof(VkPhysicalDeviceVulkan12Features, samplerMirrorClampToEdge),
+            offsetof(VkPhysicalDeviceVulkan12Features, subgroupBroadcastDynamicId) + sizeof(VkBool32)) &&
+        areFeaturesSubset(&this->enabledFeatures13, &supported13,
+            offsetof(VkPhysicalDeviceVulkan13Features, robustImageAccess),
+            offsetof(VkPhysicalDeviceVulkan13Features, maintenance4) + sizeof(VkBool32));
+}
+
 QueueFamilyIndices Device::findQueueFamilies(App *app, VkPhysicalDevice phdev) {
     QueueFamilyIndices indices{};
     
@@ -45,20 +76,33 @@ QueueFamilyIndices Device::findQueueFamilies(App *app, VkPhysicalDevice phdev) {
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(phdev, &queueFamilyCount, queueFamilies.data());
 
+    // compute without graphics runs alongside the frame instead of between its submissions
+    for (uint32_t i = 0; i < queueFamilyCount; ++i) {
+        if ((queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0 &&
+            (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0) {
+            indices.computeFamily = i;
+            indices.computeFamilyHasValue = true;
+            break;
+        }
+    }
+
     bool graphics;
     VkBool32 presentation;
     for (uint32_t i = 0; i < queueFamilyCount; ++i) {
-        if (VK_SUCCESS != vkGetPhysicalDeviceSurfaceSupportKHR(phdev,i,app->surface,&presentation)) {
+        graphics = ((queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0);
+        if (app->headless) {
+            // nothing is presented, the graphics queue stands in for the present one
+            presentation = graphics ? VK_TRUE : VK_FALSE;
+        } else if (VK_SUCCESS != vkGetPhysicalDeviceSurfaceSupportKHR(phdev,i,app->surface,&presentation)) {
             throw std::runtime_error("couldn't query surface support for queue family");
         }
-        graphics = ((queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0);
         
         if (graphics && (presentation == VK_TRUE)) {
             indices.graphicsFamily = i;
             indices.presentFamily = i;
             indices.graphicsFamilyHasValue = true;
             indices.presentFamilyHasValue = true;
-            return indices;
+            break;
         }
         if (graphics) {
             indices.graphicsFamily = i;
@@ -69,6 +113,10 @@ QueueFamilyIndices Device::findQueueFamilies(App *app, VkPhysicalDevice phdev) {
             indices.presentFamilyHasValue = true;
         }
     }
+    if (!indices.computeFamilyHasValue && indices.graphicsFamilyHasValue) {
+        indices.computeFamily = indices.graphicsFamily;
+        indices.computeFamilyHasValue = true;
+    }
     
     return indices;
 }
@@ -102,13 +150,13 @@ SwapChainSupportDetails Device::querySwapChainSupport(App *app, VkPhysicalDevice
 
 bool Device::isPhysicalDeviceSuitble(App *app, VkPhysicalDevice phdev) {
 
-    bool extensionsSupported = areDeviceExtensionsSupported(phdev);
+    bool extensionsSupported = areDeviceExtensionsSupported(phdev, this->deviceExtensions);
     bool featuresSupported = areDeviceFeaturesSupported(phdev);
 
     bool queueFamiliesComplete = findQueueFamilies(app, phdev).isComplete();
 
-    bool swapChainValid = false;
-    if (extensionsSupported) {
+    bool swapChainValid = app->headless;
+    if (extensionsSupported && !app->headless) {
         swapChainValid = querySwapChainSupport(app, phdev).isValid();
     }
 
@@ -128,9 +176,23 @@ bool Device::isPhysicalDeviceSuitble(App *app, VkPhysicalDevice phdev) {
 
 void Device::pickPhysicalDevice(App *app) {
 
-    this->deviceExtensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME
-    };
+    this->deviceExtensions = {};
+    if (!app->headless) {
+        this->deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+
+    this->enabledFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    this->enabledFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    this->enabledFeatures13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    this->enabledFeatures13.synchronization2 = VK_TRUE; // RenderGraph barriers
+    // TextureHeap: bindless sampled images
+    this->enabledFeatures.features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+    this->enabledFeatures12.runtimeDescriptorArray = VK_TRUE;
+    this->enabledFeatures12.descriptorBindingPartiallyBound = VK_TRUE;
+    this->enabledFeatures12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    this->enabledFeatures12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    this->enabledFeatures12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    this->enabledFeatures12.timelineSemaphore = VK_TRUE; // async compute completion
     
     std::vector <std::vector<VkPhysicalDevice>> phdevsByType(5,std::vector<VkPhysicalDevice> ());
     std::array <uint32_t,5> phdevTypeOrder = {1,2,3,4,0};
@@ -160,12 +222,14 @@ void Device::pickPhysicalDevice(App *app) {
     for (int32_t t : phdevTypeOrder) {
         for (VkPhysicalDevice phdev : phdevsByType[t]) {
             physicalDevice = phdev;
-            swapchainSupport = querySwapChainSupport(app, phdev);
+            if (!app->headless) {
+                swapchainSupport = querySwapChainSupport(app, phdev);
+            }
             queueFamilies = findQueueFamilies(app, phdev);
             return;
         }
     }
-    std::runtime_error("failed to find suitable physicalDevice");
+    throw std::runtime_error("failed to find suitable physicalDevice");
 }
 
 void Device::destroy() {
@@ -174,7 +238,7 @@ void Device::destroy() {
 void Device::create(App *app) {
 
     QueueFamilyIndices indices = findQueueFamilies(app, this->physicalDevice);
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily, indices.computeFamily};
     float queuePriority = 1.0f;
 
     //std::vector<VkDeviceQueueCreateInfo> &queueCreateInfos = this->queueCreateInfos;
@@ -188,18 +252,49 @@ void Device::create(App *app) {
         queueCreateInfos.push_back(queueCreateInfo);
     }
     
+    // optional: present regions, the swapchain works the same without
+    this->hasIncrementalPresent = !app->headless &&
+        areDeviceExtensionsSupported(this->physicalDevice, {VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME});
+    if (this->hasIncrementalPresent) {
+        this->deviceExtensions.push_back(VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME);
+    }
+    // optional: importing host memory, Model::ingestHostPixels
+    this->hasExternalMemoryHost =
+        areDeviceExtensionsSupported(this->physicalDevice, {VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME});
+    if (this->hasExternalMemoryHost) {
+        this->deviceExtensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+        VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties{};
+        hostProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &hostProperties;
+        vkGetPhysicalDeviceProperties2(this->physicalDevice, &properties);
+        this->hostPointerAlignment = hostProperties.minImportedHostPointerAlignment;
+    }
+
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.queueCreateInfoCount    = queueCreateInfos.size();
     createInfo.pQueueCreateInfos       = queueCreateInfos.data();
     createInfo.enabledExtensionCount   = this->deviceExtensions.size();
     createInfo.ppEnabledExtensionNames = this->deviceExtensions.data();
+
+    this->enabledFeatures.pNext = &(this->enabledFeatures12);
+    this->enabledFeatures12.pNext = &(this->enabledFeatures13);
+    this->enabledFeatures13.pNext = nullptr;
+    createInfo.pNext = &(this->enabledFeatures);
+    createInfo.pEnabledFeatures = nullptr;
     
     if (VK_SUCCESS != vkCreateDevice(this->physicalDevice, &(createInfo), nullptr, &(this->device))) {
-        std::runtime_error("failed to create vkDevice");
+        throw std::runtime_error("failed to create vkDevice");
     }
     vkGetDeviceQueue(this->device, indices.graphicsFamily, 0, &(this->graphicsQueue));
     vkGetDeviceQueue(this->device, indices.presentFamily, 0, &(this->presentQueue));
+    vkGetDeviceQueue(this->device, indices.computeFamily, 0, &(this->computeQueue));
+    this->sharingFamilies = {};
+    if (indices.computeFamily != indices.graphicsFamily) {
+        this->sharingFamilies = {indices.graphicsFamily, indices.computeFamily};
+    }
     
     if (debug) {
         VkPhysicalDeviceProperties phdevProps;
@@ -208,6 +303,7 @@ void Device::create(App *app) {
         //std::cout << "pushlimit \"" << phdevProps.limits.maxPushConstantsSize << "\"" << std::endl;
         std::cout << "graphicsQueueIndex: " << indices.graphicsFamily << std::endl;
         std::cout << "presentQueueIndex:  " << indices.presentFamily << std::endl;
+        std::cout << "computeQueueIndex:  " << indices.computeFamily << std::endl;
     }
 }
 
@@ -231,7 +327,7 @@ VkFormat Device::findSupportedFormat(
     throw std::runtime_error("failed to find supported format!");
 }
 
-uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags) {
+std::optional<uint32_t> Device::matchMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags) {
     VkPhysicalDeviceMemoryProperties memoryProperties;
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
     for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
@@ -240,7 +336,44 @@ uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags prope
             return i;
         }
     }
-    throw std::runtime_error("failed to find suitable memory type!");
+    return std::nullopt;
+}
+
+uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags) {
+    std::optional<uint32_t> memoryType = matchMemoryType(typeFilter, propertyFlags);
+    if (!memoryType.has_value()) {
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+    return memoryType.value();
+}
+
+bool Device::hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags) {
+    return matchMemoryType(typeFilter, propertyFlags).has_value();
+}
+
+uint32_t Device::bufferMemoryTypes(VkDeviceSize size, VkBufferUsageFlags usage) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkDeviceBufferMemoryRequirements requirementsInfo{};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_DEVICE_BUFFER_MEMORY_REQUIREMENTS;
+    requirementsInfo.pCreateInfo = &bufferInfo;
+    VkMemoryRequirements2 requirements{};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    vkGetDeviceBufferMemoryRequirements(this->device, &requirementsInfo, &requirements);
+    return requirements.memoryRequirements.memoryTypeBits;
+}
+
+uint32_t Device::imageMemoryTypes(const VkImageCreateInfo &imageInfo) {
+    VkDeviceImageMemoryRequirements requirementsInfo{};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+    requirementsInfo.pCreateInfo = &imageInfo;
+    VkMemoryRequirements2 requirements{};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    vkGetDeviceImageMemoryRequirements(this->device, &requirementsInfo, &requirements);
+    return requirements.memoryRequirements.memoryTypeBits;
 }
 
 void Device::createImage(
@@ -279,6 +412,16 @@ void Device::createImage(
 // ################
 
 void Device::destroyCommandPool() {
+    this->waitGraphics(this->graphicsTimelineValue);
+    collectRetired(true);
+    if (!this->deferredCommands.empty()) {
+        // never submitted
+        vkFreeCommandBuffers(this->device, this->commandPool,
+                             static_cast<uint32_t>(this->deferredCommands.size()), this->deferredCommands.data());
+        this->deferredCommands.clear();
+    }
+    vkDestroySemaphore(this->device, this->graphicsTimeline, nullptr);
+    this->graphicsTimeline = VK_NULL_HANDLE;
     vkDestroyCommandPool(this->device, this->commandPool, nullptr);
 }
 void Device::createCommandPool() {
@@ -291,6 +434,185 @@ void Device::createCommandPool() {
     if (VK_SUCCESS != vkCreateCommandPool(this->device, &poolInfo, nullptr, &(this->commandPool))) {
         throw std::runtime_error("failed to create command pool!");
     }
+
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &timelineInfo;
+    if (VK_SUCCESS != vkCreateSemaphore(this->device, &semaphoreInfo, nullptr, &this->graphicsTimeline)) {
+        throw std::runtime_error("failed to create graphics timeline semaphore!");
+    }
+    this->graphicsTimelineValue = 0;
+    this->lastDeferredValue = 0;
+}
+
+VkCommandBuffer Device::beginSingleTimeCommands() {
+    VkCommandBuffer commandBuffer;
+    VkCommandBufferAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandPool = this->commandPool;
+    allocateInfo.commandBufferCount = 1;
+    if (VK_SUCCESS != vkAllocateCommandBuffers(this->device, &allocateInfo, &commandBuffer)) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &beginInfo)) {
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
+    return commandBuffer;
+}
+
+void Device::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+
+    // the timeline signal is ordered after every earlier submission to the queue as well
+    uint64_t value = submitGraphics({commandBuffer}, {}, {}, VK_NULL_HANDLE);
+    waitGraphics(value);
+
+    vkFreeCommandBuffers(this->device, this->commandPool, 1, &commandBuffer);
+}
+
+// ######################
+//  SUBMISSION BATCHING
+// ######################
+
+// Uploads used to be submitted one by one, each followed by vkQueueWaitIdle. Now they are only
+// recorded and handed to deferGraphicsCommands; they go to the queue in the same vkQueueSubmit2 as
+// the next frame (or whatever is submitted next), ahead of its command buffers. Their barriers
+// order them against the commands after, and every wait of the batch names its own stages, so an
+// upload never waits for the swapchain image the frame waits for.
+
+std::mutex &Device::queueMutex(VkQueue queue) {
+    // the first name of a queue picks its mutex
+    if (queue == this->graphicsQueue) return this->graphicsQueueMutex;
+    if (queue == this->computeQueue) return this->computeQueueMutex;
+    return this->presentQueueMutex;
+}
+
+void Device::deferGraphicsCommands(VkCommandBuffer commandBuffer) {
+    this->deferredCommands.push_back(commandBuffer);
+}
+
+uint64_t Device::submitGraphics(
+    const std::vector<VkCommandBuffer> &commandBuffers,
+    std::vector<VkSemaphoreSubmitInfo> waits,
+    std::vector<VkSemaphoreSubmitInfo> signals,
+    VkFence fence
+) {
+    collectRetired(false);
+
+    std::vector<VkSemaphore> semaphores = {};
+    std::vector<uint64_t> values = {};
+    std::vector<VkPipelineStageFlags> stages = {};
+    takeGraphicsWaits(semaphores, values, stages);
+    for (size_t i = 0; i < semaphores.size(); i++) {
+        VkSemaphoreSubmitInfo wait{};
+        wait.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        wait.semaphore = semaphores[i];
+        wait.value = values[i];
+        // the legacy stage bits have the same values in VkPipelineStageFlags2
+        wait.stageMask = static_cast<VkPipelineStageFlags2>(stages[i]);
+        waits.push_back(wait);
+    }
+
+    uint64_t value = ++this->graphicsTimelineValue;
+    VkSemaphoreSubmitInfo timelineSignal{};
+    timelineSignal.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    timelineSignal.semaphore = this->graphicsTimeline;
+    timelineSignal.value = value;
+    timelineSignal.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    signals.push_back(timelineSignal);
+
+    std::vector<VkCommandBufferSubmitInfo> commandInfos = {};
+    for (VkCommandBuffer commandBuffer : this->deferredCommands) {
+        VkCommandBufferSubmitInfo commandInfo{};
+        commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        commandInfo.commandBuffer = commandBuffer;
+        commandInfos.push_back(commandInfo);
+        this->retired.push_back({value, [this, commandBuffer]() {
+            vkFreeCommandBuffers(this->device, this->commandPool, 1, &commandBuffer);
+        }});
+    }
+    for (VkCommandBuffer commandBuffer : commandBuffers) {
+        VkCommandBufferSubmitInfo commandInfo{};
+        commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        commandInfo.commandBuffer = commandBuffer;
+        commandInfos.push_back(commandInfo);
+    }
+    if (!this->deferredCommands.empty()) {
+        this->deferredCommandCount += this->deferredCommands.size();
+        this->lastDeferredValue = value;
+        this->deferredCommands.clear();
+    }
+
+    VkSubmitInfo2 submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    submitInfo.waitSemaphoreInfoCount = static_cast<uint32_t>(waits.size());
+    submitInfo.pWaitSemaphoreInfos = waits.data();
+    submitInfo.commandBufferInfoCount = static_cast<uint32_t>(commandInfos.size());
+    submitInfo.pCommandBufferInfos = commandInfos.data();
+    submitInfo.signalSemaphoreInfoCount = static_cast<uint32_t>(signals.size());
+    submitInfo.pSignalSemaphoreInfos = signals.data();
+    std::lock_guard<std::mutex> queueLock(this->queueMutex(this->graphicsQueue));
+    if (VK_SUCCESS != vkQueueSubmit2(this->graphicsQueue, 1, &submitInfo, fence)) {
+        throw std::runtime_error("failed to submit command buffer!");
+    }
+    this->graphicsSubmitCount++;
+    return value;
+}
+
+uint64_t Device::flushDeferredGraphics() {
+    if (!this->deferredCommands.empty()) {
+        submitGraphics({}, {}, {}, VK_NULL_HANDLE);
+    }
+    uint64_t reached = 0;
+    vkGetSemaphoreCounterValue(this->device, this->graphicsTimeline, &reached);
+    return reached >= this->lastDeferredValue ? 0 : this->lastDeferredValue;
+}
+
+void Device::waitGraphics(uint64_t value) {
+    if (value == 0) return;
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &this->graphicsTimeline;
+    waitInfo.pValues = &value;
+    vkWaitSemaphores(this->device, &waitInfo, UINT64_MAX);
+}
+
+// ######################
+//  DEFERRED DESTRUCTION
+// ######################
+
+// Replacing an image, a buffer or a pipeline at runtime used to mean waiting for the queue to drain,
+// since frames in flight may still use the old one. Retired objects are kept instead until the
+// graphics timeline passes the last submission made before they were retired; the queue keeps its
+// order, as the values only grow.
+
+void Device::retire(std::function<void()> destroy) {
+    this->retired.push_back({this->graphicsTimelineValue, std::move(destroy)});
+    this->retiredCount++;
+}
+
+void Device::collectRetired(bool all) {
+    uint64_t reached = UINT64_MAX;
+    if (!all) {
+        vkGetSemaphoreCounterValue(this->device, this->graphicsTimeline, &reached);
+    }
+    while (!this->retired.empty() && this->retired.front().first <= reached) {
+        std::function<void()> destroy = std::move(this->retired.front().second);
+        this->retired.pop_front();
+        destroy();
+    }
 }
 
 void Device::createBuffer(
@@ -323,3 +645,93 @@ void Device::createBuffer(
 
     vkBindBufferMemory(this->device, buffer, bufferMemory, 0);
 }
+
+void Device::importHostBuffer(void *pointer, VkDeviceSize size, VkBuffer &buffer, VkDeviceMemory &memory) {
+    if (!this->hasExternalMemoryHost) {
+        throw std::runtime_error("failed to import host memory, VK_EXT_external_memory_host is not supported!");
+    }
+    VkDeviceSize alignment = this->hostPointerAlignment;
+    if (reinterpret_cast<uintptr_t>(pointer) % alignment != 0) {
+        throw std::runtime_error("failed to import host memory, the pointer is not aligned!");
+    }
+    if (size % alignment != 0) {
+        throw std::runtime_error("failed to import host memory, the size is not a multiple of the alignment!");
+    }
+
+    // which memory types the pointer can be imported as
+    auto getHostPointerProperties = (PFN_vkGetMemoryHostPointerPropertiesEXT)vkGetDeviceProcAddr(
+        this->device, "vkGetMemoryHostPointerPropertiesEXT"
+    );
+    VkMemoryHostPointerPropertiesEXT pointerProperties{};
+    pointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+    if (nullptr == getHostPointerProperties || VK_SUCCESS != getHostPointerProperties(
+            this->device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, pointer, &pointerProperties)) {
+        throw std::runtime_error("failed to query host pointer properties!");
+    }
+
+    VkExternalMemoryBufferCreateInfo externalInfo{};
+    externalInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+    externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.pNext = &externalInfo;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (VK_SUCCESS != vkCreateBuffer(this->device, &bufferInfo, nullptr, &buffer)) {
+        throw std::runtime_error("failed to create host import buffer!");
+    }
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(this->device, buffer, &memoryRequirements);
+
+    VkImportMemoryHostPointerInfoEXT importInfo{};
+    importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+    importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    importInfo.pHostPointer = pointer;
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.pNext = &importInfo;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = findMemoryType(
+        memoryRequirements.memoryTypeBits & pointerProperties.memoryTypeBits, 0
+    );
+    if (VK_SUCCESS != vkAllocateMemory(this->device, &allocInfo, nullptr, &memory)) {
+        vkDestroyBuffer(this->device, buffer, nullptr);
+        throw std::runtime_error("failed to import host memory!");
+    }
+    vkBindBufferMemory(this->device, buffer, memory, 0);
+}
+
+void Device::setConcurrentSharing(VkImageCreateInfo &imageInfo) {
+    if (this->sharingFamilies.empty()) {
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        return;
+    }
+    imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(this->sharingFamilies.size());
+    imageInfo.pQueueFamilyIndices = this->sharingFamilies.data();
+}
+
+void Device::addGraphicsWait(VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags stages) {
+    std::lock_guard<std::mutex> lock(this->graphicsWaitsMutex);
+    this->graphicsWaitSemaphores.push_back(semaphore);
+    this->graphicsWaitValues.push_back(value);
+    this->graphicsWaitStages.push_back(stages);
+}
+
+// appends the pending waits, a binary semaphore the caller already put in gets a dummy value
+void Device::takeGraphicsWaits(
+    std::vector<VkSemaphore> &semaphores,
+    std::vector<uint64_t> &values,
+    std::vector<VkPipelineStageFlags> &stages
+) {
+    std::lock_guard<std::mutex> lock(this->graphicsWaitsMutex);
+    values.resize(semaphores.size(), 0);
+    semaphores.insert(semaphores.end(), this->graphicsWaitSemaphores.begin(), this->graphicsWaitSemaphores.end());
+    values.insert(values.end(), this->graphicsWaitValues.begin(), this->graphicsWaitValues.end());
+    stages.insert(stages.end(), this->graphicsWaitStages.begin(), this->graphicsWaitStages.end());
+    this->graphicsWaitSemaphores.clear();
+    this->graphicsWaitValues.clear();
+    this->graphicsWaitStages.clear();
+}
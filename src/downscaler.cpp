@@ -0,0 +1,366 @@
+#include "types.hpp"
+#include <cstdint>
+#include <cmath>
+#include <vulkan/vulkan_core.h>
+
+#include "downscale.comp.h" // present by CMake
+
+// Bilinear sampling of a 4320p texture in a 720p window reads 4 of every ~36 texels that fall into
+// a pixel, the rest aliases. The copy is filtered over the whole footprint instead, horizontally
+// into a transient image then vertically into the result, and is small enough to stay in cache.
+// Zooming reruns it: every run gets a descriptor set no pending run uses, the intermediate lives
+// in a heap kept across runs, and replaced copies are kept as spares for their extent.
+
+// matches Params in shaders/downscale.comp.glsl
+struct DownscaleParams {
+    int32_t srcExtent[2];
+    int32_t dstExtent[2];
+    uint32_t sourceIndex;
+    uint32_t pass;
+    uint32_t filterType;
+};
+
+static const uint32_t DOWNSCALE_TILE = 64;     // local_size_x of the shader
+static const uint32_t DOWNSCALE_SPARES = 4;    // replaced copies kept for reuse
+static const uint32_t DOWNSCALE_STEPS = 4;     // extents per octave of zoom, coarser means more reuse
+
+bool Downscaler::parseFilter(const std::string &name, Filter &filter) {
+    if (name == "none") {
+        filter = FILTER_NONE;
+    } else if (name == "box") {
+        filter = FILTER_BOX;
+    } else if (name == "lanczos") {
+        filter = FILTER_LANCZOS3;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void Downscaler::create() {
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (VK_SUCCESS != vkCreateDescriptorSetLayout(this->device->device, &layoutInfo, nullptr, &this->setLayout)) {
+        throw std::runtime_error("failed to create downscaler descriptor set layout!");
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSize.descriptorCount = static_cast<uint32_t>(bindings.size() * this->runSets.size());
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = static_cast<uint32_t>(this->runSets.size());
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (VK_SUCCESS != vkCreateDescriptorPool(this->device->device, &poolInfo, nullptr, &this->descriptorPool)) {
+        throw std::runtime_error("failed to create downscaler descriptor pool!");
+    }
+
+    // one set per run in flight, a new run never rewrites the one a pending run uses
+    for (RunSet &runSet : this->runSets) {
+        VkDescriptorSetAllocateInfo allocateInfo{};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocateInfo.descriptorPool = this->descriptorPool;
+        allocateInfo.descriptorSetCount = 1;
+        allocateInfo.pSetLayouts = &this->setLayout;
+        if (VK_SUCCESS != vkAllocateDescriptorSets(this->device->device, &allocateInfo, &runSet.descriptorSet)) {
+            throw std::runtime_error("failed to allocate downscaler descriptor set!");
+        }
+        runSet.lastUse = 0;
+    }
+
+    // set 0 - the texture heap the source is read from, set 1 - the storage images
+    std::array<VkDescriptorSetLayout, 2> setLayouts = {this->textures->descriptorSetLayout, this->setLayout};
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DownscaleParams);
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (VK_SUCCESS != vkCreatePipelineLayout(this->device->device, &pipelineLayoutInfo, nullptr, &this->pipelineLayout)) {
+        throw std::runtime_error("failed to create downscaler pipeline layout!");
+    }
+
+    VkShaderModuleCreateInfo shaderCI{};
+    shaderCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderCI.codeSize = sizeof(downscaleCompShaderCode);
+    shaderCI.pCode = downscaleCompShaderCode;
+    if (VK_SUCCESS != vkCreateShaderModule(this->device->device, &shaderCI, nullptr, &this->shaderModule)) {
+        throw std::runtime_error("failed to create downscale shader module");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = this->shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = this->pipelineLayout;
+    if (VK_SUCCESS != vkCreateComputePipelines(this->device->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &this->pipeline)) {
+        throw std::runtime_error("failed to create downscale pipeline!");
+    }
+}
+
+void Downscaler::destroyOutput(const Output &output) {
+    this->textures->release(TextureHeap::BINDING_2D, output.textureIndex);
+    vkDestroyImageView(this->device->device, output.view, nullptr);
+    vkDestroyImage(this->device->device, output.image, nullptr);
+    vkFreeMemory(this->device->device, output.memory, nullptr);
+}
+
+// frames in flight may still sample the old copy, it becomes a spare once they are done
+void Downscaler::destroyImage() {
+    if (VK_NULL_HANDLE == this->image) return;
+    Output output = {this->image, this->memory, this->view, this->textureIndex, this->extent};
+    this->device->retire([this, output]() {
+        this->spares.push_back(output);
+        if (this->spares.size() > DOWNSCALE_SPARES) {
+            destroyOutput(this->spares.front());
+            this->spares.erase(this->spares.begin());
+        }
+    });
+    this->image = VK_NULL_HANDLE;
+    this->view = VK_NULL_HANDLE;
+    this->memory = VK_NULL_HANDLE;
+    this->extent = {0, 0};
+}
+
+void Downscaler::destroy() {
+    destroyImage();
+    // the device is idle by now
+    this->device->collectRetired(true);
+    for (const Output &output : this->spares) {
+        destroyOutput(output);
+    }
+    this->spares.clear();
+    this->heap.destroy();
+    vkDestroyPipeline(this->device->device, this->pipeline, nullptr);
+    vkDestroyShaderModule(this->device->device, this->shaderModule, nullptr);
+    vkDestroyPipelineLayout(this->device->device, this->pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(this->device->device, this->descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(this->device->device, this->setLayout, nullptr);
+    this->pipeline = VK_NULL_HANDLE;
+    this->shaderModule = VK_NULL_HANDLE;
+    this->pipelineLayout = VK_NULL_HANDLE;
+    this->descriptorPool = VK_NULL_HANDLE;
+    this->runSets = {};
+    this->setLayout = VK_NULL_HANDLE;
+}
+
+void Downscaler::setSource(VkImage image, uint32_t index) {
+    this->sourceImage = image;
+    this->sourceIndex = index;
+    this->stale = true;
+}
+
+Downscaler::RunSet &Downscaler::nextRunSet() {
+    uint64_t reached = 0;
+    vkGetSemaphoreCounterValue(this->device->device, this->device->graphicsTimeline, &reached);
+    RunSet *oldest = &this->runSets[0];
+    for (RunSet &runSet : this->runSets) {
+        if (runSet.lastUse <= reached) return runSet;
+        if (runSet.lastUse < oldest->lastUse) oldest = &runSet;
+    }
+    // every set is still in flight (zooming faster than the GPU downscales), the oldest is closest
+    this->device->waitGraphics(oldest->lastUse);
+    return *oldest;
+}
+
+// a spare of that extent, else a new image
+Downscaler::Output Downscaler::takeOutput(VkExtent2D extent) {
+    for (size_t i = this->spares.size(); i-- > 0;) {
+        if (this->spares[i].extent.width == extent.width && this->spares[i].extent.height == extent.height) {
+            Output output = this->spares[i];
+            this->spares.erase(this->spares.begin() + i);
+            return output;
+        }
+    }
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {extent.width, extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;  // linear light, the source is decoded from sRGB
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    Output output{};
+    output.extent = extent;
+    this->device->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, output.image, output.memory);
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = output.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = imageInfo.format;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    if (VK_SUCCESS != vkCreateImageView(this->device->device, &viewInfo, nullptr, &output.view)) {
+        throw std::runtime_error("failed to create downscaled image view!");
+    }
+    output.textureIndex = this->textures->allocate(TextureHeap::BINDING_2D, output.view);
+    return output;
+}
+
+uint32_t Downscaler::update(VkExtent2D displayExtent) {
+    // below 2:1 bilinear hardly aliases, and the copy would get about as big as the source
+    VkExtent2D wanted = {
+        std::min(displayExtent.width, this->sourceExtent.width),
+        std::min(displayExtent.height, this->sourceExtent.height)
+    };
+    if (this->filter == FILTER_NONE ||
+        wanted.width * 2 > this->sourceExtent.width || wanted.height * 2 > this->sourceExtent.height) {
+        return this->sourceIndex;
+    }
+    // rounded up to a few scales per octave, so zooming in steps lands on extents seen before (and
+    // their spare images); the copy is then minified by at most 2^(1/DOWNSCALE_STEPS) when drawn
+    double scale = std::max(
+        static_cast<double>(wanted.width) / this->sourceExtent.width,
+        static_cast<double>(wanted.height) / this->sourceExtent.height
+    );
+    scale = std::exp2(-std::floor(-std::log2(scale) * DOWNSCALE_STEPS) / DOWNSCALE_STEPS);
+    wanted = {
+        std::min(this->sourceExtent.width, static_cast<uint32_t>(std::ceil(this->sourceExtent.width * scale))),
+        std::min(this->sourceExtent.height, static_cast<uint32_t>(std::ceil(this->sourceExtent.height * scale)))
+    };
+    bool sameExtent = wanted.width == this->extent.width && wanted.height == this->extent.height;
+    if (sameExtent && VK_NULL_HANDLE != this->image && !this->stale) {
+        return this->textureIndex;
+    }
+
+    // other contents at the same extent are written over the current copy, ordered after the
+    // frames sampling it by the graph's first barrier; a new extent takes a spare or a new image
+    Output output = {this->image, this->memory, this->view, this->textureIndex, this->extent};
+    if (!sameExtent || VK_NULL_HANDLE == this->image) {
+        output = takeOutput(wanted);
+    }
+
+    // horizontal pass output: downscaled width, source height
+    VkImageCreateInfo intermediateInfo{};
+    intermediateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    intermediateInfo.imageType = VK_IMAGE_TYPE_2D;
+    intermediateInfo.extent = {wanted.width, this->sourceExtent.height, 1};
+    intermediateInfo.mipLevels = 1;
+    intermediateInfo.arrayLayers = 1;
+    intermediateInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    intermediateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    intermediateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    intermediateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    RenderGraph downscaleGraph{};
+    downscaleGraph.device = this->device;
+    downscaleGraph.heap = &this->heap;
+    RenderGraph::ResourceId source = downscaleGraph.importImage(
+        "source", this->sourceImage, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        RenderGraph::ACCESS_FRAGMENT_SAMPLED_READ
+    );
+    RenderGraph::ResourceId intermediate = downscaleGraph.createImage("intermediate", intermediateInfo);
+    // overwritten whole, the old contents need not survive the transition
+    RenderGraph::ResourceId result = downscaleGraph.importImage(
+        "downscaled", output.image, output.view, VK_IMAGE_LAYOUT_UNDEFINED, RenderGraph::ACCESS_FRAGMENT_SAMPLED_READ
+    );
+    // one no pending run uses, it can be rewritten right away
+    RunSet &runSet = nextRunSet();
+    DownscaleParams params{};
+    params.sourceIndex = this->sourceIndex;
+    params.filterType = this->filter == FILTER_BOX ? 0 : 1;
+    auto dispatch = [&](VkCommandBuffer commandBuffer, uint32_t pass, VkExtent2D src, VkExtent2D dst) {
+        params.srcExtent[0] = static_cast<int32_t>(src.width);
+        params.srcExtent[1] = static_cast<int32_t>(src.height);
+        params.dstExtent[0] = static_cast<int32_t>(dst.width);
+        params.dstExtent[1] = static_cast<int32_t>(dst.height);
+        params.pass = pass;
+        vkCmdPushConstants(
+            commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DownscaleParams), &params
+        );
+        // x - tiles along the filtered axis, y - lines across it
+        uint32_t length = pass == 0 ? dst.width : dst.height;
+        uint32_t lines = pass == 0 ? dst.height : dst.width;
+        vkCmdDispatch(commandBuffer, (length + DOWNSCALE_TILE - 1) / DOWNSCALE_TILE, lines, 1);
+    };
+    VkExtent2D intermediateExtent = {wanted.width, this->sourceExtent.height};
+    downscaleGraph.addPass(
+        "downscale horizontal",
+        {{source, RenderGraph::ACCESS_COMPUTE_SAMPLED_READ}},
+        {{intermediate, RenderGraph::ACCESS_COMPUTE_STORAGE_WRITE}},
+        [&](VkCommandBuffer commandBuffer, RenderGraph &graph) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+            this->textures->bind(commandBuffer, this->pipelineLayout, VK_PIPELINE_BIND_POINT_COMPUTE);
+            vkCmdBindDescriptorSets(
+                commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 1, 1, &runSet.descriptorSet, 0, nullptr
+            );
+            dispatch(commandBuffer, 0, this->sourceExtent, intermediateExtent);
+        }
+    );
+    // reads what the horizontal pass wrote: the graph puts a COMPUTE -> COMPUTE barrier in between
+    // (the debug output shows it as pass "downscale vertical" after 1 barriers)
+    downscaleGraph.addPass(
+        "downscale vertical",
+        {{intermediate, RenderGraph::ACCESS_COMPUTE_STORAGE_READ}},
+        {{result, RenderGraph::ACCESS_COMPUTE_STORAGE_WRITE}},
+        [&](VkCommandBuffer commandBuffer, RenderGraph &graph) {
+            dispatch(commandBuffer, 1, intermediateExtent, wanted);
+        }
+    );
+    downscaleGraph.compile();
+
+    // the transient view exists once the graph is compiled
+    std::array<VkDescriptorImageInfo, 2> imageInfos{};
+    imageInfos[0] = {VK_NULL_HANDLE, downscaleGraph.getImageView(intermediate), VK_IMAGE_LAYOUT_GENERAL};
+    imageInfos[1] = {VK_NULL_HANDLE, output.view, VK_IMAGE_LAYOUT_GENERAL};
+    std::array<VkWriteDescriptorSet, 2> writes{};
+    for (uint32_t i = 0; i < writes.size(); i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = runSet.descriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[i].pImageInfo = &imageInfos[i];
+    }
+    vkUpdateDescriptorSets(this->device->device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+    // submitted on its own ahead of the next frame, without waiting for it; the command buffer and
+    // the transient image go once it is done
+    VkCommandBuffer commandBuffer = this->device->beginSingleTimeCommands();
+    downscaleGraph.execute(commandBuffer);
+    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+    runSet.lastUse = this->device->submitGraphics({commandBuffer}, {}, {}, VK_NULL_HANDLE);
+    this->device->retire([this, commandBuffer, graph = std::move(downscaleGraph)]() mutable {
+        vkFreeCommandBuffers(this->device->device, this->device->commandPool, 1, &commandBuffer);
+        graph.destroy();
+    });
+
+    if (output.image != this->image) {
+        destroyImage();
+    }
+    this->image = output.image;
+    this->memory = output.memory;
+    this->view = output.view;
+    this->extent = output.extent;
+    this->textureIndex = output.textureIndex;
+    this->stale = false;
+    this->runCount++;
+    if (debug) {
+        std::cout << "downscaler: " << this->sourceExtent.width << "x" << this->sourceExtent.height << " -> "
+                  << wanted.width << "x" << wanted.height << std::endl;
+    }
+    return this->textureIndex;
+}
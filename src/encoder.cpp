@@ -0,0 +1,114 @@
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb/stb_image_write.h"
+#include "types.hpp"
+#include <cstdint>
+#include <fstream>
+
+// ######
+//  JOBS
+// ######
+
+void ImageEncoder::create(JobSystem *jobs) {
+    this->jobs = jobs;
+    this->pendingCount = 0;
+}
+
+void ImageEncoder::destroy() {
+    flush();
+}
+
+void ImageEncoder::flush() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->jobDone.wait(lock, [this] { return this->pendingCount == 0; });
+}
+
+void ImageEncoder::push(Job &&job) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (this->maxPending != 0) {
+        this->jobDone.wait(lock, [this] { return this->pendingCount < this->maxPending; });
+    }
+    this->pendingCount++;
+    lock.unlock();
+
+    this->jobs->submit([this, job = std::move(job)]() mutable {
+        auto start = std::chrono::steady_clock::now();
+        encode(job);
+        if (job.done) {
+            job.done();
+        }
+        auto end = std::chrono::steady_clock::now();
+        this->busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        this->encodedCount++;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->pendingCount--;
+        }
+        this->jobDone.notify_all();
+    });
+}
+
+size_t ImageEncoder::pending() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->pendingCount;
+}
+
+// ##########
+//  ENCODING
+// ##########
+
+bool ImageEncoder::parseFormat(const std::string &name, Format &format) {
+    if (name == "png") {
+        format = PNG;
+    } else if (name == "jpg" || name == "jpeg") {
+        format = JPEG;
+    } else if (name == "raw") {
+        format = RAW;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *ImageEncoder::extension(Format format) {
+    switch (format) {
+        case PNG:  return ".png";
+        case JPEG: return ".jpg";
+        case RAW:  return ".rgba";
+    }
+    return "";
+}
+
+void ImageEncoder::encode(Job &job) {
+    uint8_t *pixels = job.pixels.data();
+    size_t size = job.pixels.size();
+    if (nullptr != job.data) {
+        pixels = job.data;
+        size = static_cast<size_t>(job.width) * job.height * 4;
+    }
+    if (job.bgra) {
+        for (size_t i = 0; i + 3 < size; i += 4) {
+            std::swap(pixels[i], pixels[i + 2]);
+        }
+    }
+
+    int ok = 0;
+    int width = static_cast<int>(job.width);
+    int height = static_cast<int>(job.height);
+    switch (job.format) {
+        case PNG:
+            ok = stbi_write_png(job.path.c_str(), width, height, 4, pixels, width * 4);
+            break;
+        case JPEG:
+            ok = stbi_write_jpg(job.path.c_str(), width, height, 4, pixels, 90);
+            break;
+        case RAW: {
+            std::ofstream file(job.path, std::ios::binary);
+            file.write(reinterpret_cast<const char*>(pixels), size);
+            ok = file.good() ? 1 : 0;
+            break;
+        }
+    }
+    if (0 == ok) {
+        std::cerr << "failed to write " << job.path << std::endl;
+    }
+}
@@ -0,0 +1,393 @@
+#include "types.hpp"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vulkan/vulkan_core.h>
+
+#include "histogram.comp.h" // present by CMake
+
+// Runs on Device::computeQueue like the Adjuster, completion is a timeline semaphore that poll()
+// reads and the TimelineWaiter blocks on. The shader's atomics land in a device local buffer, the
+// same submission copies it to a host visible one, so the CPU never scans StbImage::pixels and the
+// GPU never does atomics over the bus.
+
+// matches Params in shaders/histogram.comp.glsl
+struct HistogramParams {
+    uint32_t sourceIndex;
+};
+
+// matches Result in shaders/histogram.comp.glsl
+struct HistogramResult {
+    uint32_t bins[Histogram::CHANNEL_COUNT * Histogram::BIN_COUNT];
+    uint32_t minBits[Histogram::CHANNEL_COUNT];
+    uint32_t maxBits[Histogram::CHANNEL_COUNT];
+};
+
+static const uint32_t HISTOGRAM_TILE = 16;          // local_size_x/y of the shader
+// workgroups per axis at most, the rest is covered by the grid stride loop; enough to fill a
+// device, few enough that flushing the shared bins stays cheap
+static const uint32_t HISTOGRAM_MAX_GROUPS = 32;
+
+float Histogram::Stats::percentile(Channel channel, float fraction) const {
+    uint64_t target = static_cast<uint64_t>(std::ceil(fraction * this->pixelCount));
+    uint64_t sum = 0;
+    for (uint32_t bin = 0; bin < BIN_COUNT; bin++) {
+        sum += this->bins[channel][bin];
+        if (sum >= target && sum > 0) {
+            return static_cast<float>(bin) / (BIN_COUNT - 1);
+        }
+    }
+    return 1.0f;
+}
+
+// ########
+//  CREATE
+// ########
+
+void Histogram::create() {
+    VkPhysicalDeviceSubgroupProperties subgroupProps{};
+    subgroupProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    VkPhysicalDeviceProperties2 phdevProps{};
+    phdevProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    phdevProps.pNext = &subgroupProps;
+    vkGetPhysicalDeviceProperties2(this->device->physicalDevice, &phdevProps);
+    VkSubgroupFeatureFlags needed =
+        VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_VOTE_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+    this->supported = (subgroupProps.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+        (subgroupProps.supportedOperations & needed) == needed;
+    if (!this->supported) {
+        std::cout << "histogram: no subgroup vote/arithmetic in compute shaders, disabled" << std::endl;
+        return;
+    }
+
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+    if (VK_SUCCESS != vkCreateDescriptorSetLayout(this->device->device, &layoutInfo, nullptr, &this->setLayout)) {
+        throw std::runtime_error("failed to create histogram descriptor set layout!");
+    }
+
+    VkDescriptorPoolSize poolSize = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1};
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (VK_SUCCESS != vkCreateDescriptorPool(this->device->device, &poolInfo, nullptr, &this->descriptorPool)) {
+        throw std::runtime_error("failed to create histogram descriptor pool!");
+    }
+
+    // set 0 - the texture heap the image is read from, set 1 - the result
+    std::array<VkDescriptorSetLayout, 2> setLayouts = {this->textures->descriptorSetLayout, this->setLayout};
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(HistogramParams);
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (VK_SUCCESS != vkCreatePipelineLayout(this->device->device, &pipelineLayoutInfo, nullptr, &this->pipelineLayout)) {
+        throw std::runtime_error("failed to create histogram pipeline layout!");
+    }
+
+    VkShaderModuleCreateInfo shaderCI{};
+    shaderCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderCI.codeSize = sizeof(histogramCompShaderCode);
+    shaderCI.pCode = histogramCompShaderCode;
+    if (VK_SUCCESS != vkCreateShaderModule(this->device->device, &shaderCI, nullptr, &this->shaderModule)) {
+        throw std::runtime_error("failed to create histogram shader module");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = this->shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = this->pipelineLayout;
+    if (VK_SUCCESS != vkCreateComputePipelines(this->device->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &this->pipeline)) {
+        throw std::runtime_error("failed to create histogram pipeline!");
+    }
+
+    VkCommandPoolCreateInfo commandPoolInfo{};
+    commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolInfo.queueFamilyIndex = this->device->queueFamilies.computeFamily;
+    commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (VK_SUCCESS != vkCreateCommandPool(this->device->device, &commandPoolInfo, nullptr, &this->commandPool)) {
+        throw std::runtime_error("failed to create histogram command pool!");
+    }
+    VkCommandBufferAllocateInfo commandBufferInfo{};
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferInfo.commandPool = this->commandPool;
+    commandBufferInfo.commandBufferCount = 1;
+    if (VK_SUCCESS != vkAllocateCommandBuffers(this->device->device, &commandBufferInfo, &this->commandBuffer)) {
+        throw std::runtime_error("failed to allocate histogram command buffer!");
+    }
+
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &timelineInfo;
+    if (VK_SUCCESS != vkCreateSemaphore(this->device->device, &semaphoreInfo, nullptr, &this->timeline)) {
+        throw std::runtime_error("failed to create histogram timeline semaphore!");
+    }
+    this->timelineValue = 0;
+
+    this->device->createBuffer(
+        sizeof(HistogramResult),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        this->resultBuffer,
+        this->resultMemory
+    );
+    this->device->createBuffer(
+        sizeof(HistogramResult),
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        this->readbackBuffer,
+        this->readbackMemory
+    );
+    vkMapMemory(this->device->device, this->readbackMemory, 0, sizeof(HistogramResult), 0, &this->readbackData);
+
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = this->descriptorPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &this->setLayout;
+    if (VK_SUCCESS != vkAllocateDescriptorSets(this->device->device, &allocateInfo, &this->descriptorSet)) {
+        throw std::runtime_error("failed to allocate histogram descriptor set!");
+    }
+    VkDescriptorBufferInfo resultInfo = {this->resultBuffer, 0, VK_WHOLE_SIZE};
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = this->descriptorSet;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &resultInfo;
+    vkUpdateDescriptorSets(this->device->device, 1, &write, 0, nullptr);
+}
+
+void Histogram::destroy() {
+    if (!this->supported) return;
+    vkDeviceWaitIdle(this->device->device);
+    if (nullptr != this->waiter) {
+        this->waiter->remove(this->timeline);
+    }
+    this->job = {};
+    this->hasPending = false;
+
+    vkUnmapMemory(this->device->device, this->readbackMemory);
+    vkDestroyBuffer(this->device->device, this->readbackBuffer, nullptr);
+    vkFreeMemory(this->device->device, this->readbackMemory, nullptr);
+    vkDestroyBuffer(this->device->device, this->resultBuffer, nullptr);
+    vkFreeMemory(this->device->device, this->resultMemory, nullptr);
+    vkDestroySemaphore(this->device->device, this->timeline, nullptr);
+    vkDestroyCommandPool(this->device->device, this->commandPool, nullptr);
+    vkDestroyPipeline(this->device->device, this->pipeline, nullptr);
+    vkDestroyShaderModule(this->device->device, this->shaderModule, nullptr);
+    vkDestroyPipelineLayout(this->device->device, this->pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(this->device->device, this->descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(this->device->device, this->setLayout, nullptr);
+    this->readbackData = nullptr;
+    this->readbackBuffer = VK_NULL_HANDLE;
+    this->readbackMemory = VK_NULL_HANDLE;
+    this->resultBuffer = VK_NULL_HANDLE;
+    this->resultMemory = VK_NULL_HANDLE;
+    this->timeline = VK_NULL_HANDLE;
+    this->commandPool = VK_NULL_HANDLE;
+    this->commandBuffer = VK_NULL_HANDLE;
+    this->pipeline = VK_NULL_HANDLE;
+    this->shaderModule = VK_NULL_HANDLE;
+    this->pipelineLayout = VK_NULL_HANDLE;
+    this->descriptorSet = VK_NULL_HANDLE;
+    this->descriptorPool = VK_NULL_HANDLE;
+    this->setLayout = VK_NULL_HANDLE;
+}
+
+// ######
+//  JOBS
+// ######
+
+void Histogram::request(VkImage image, uint32_t index, VkExtent2D extent) {
+    if (!this->supported) return;
+    this->pending = {false, 0, image, index, extent};
+    this->hasPending = true;
+    start();
+}
+
+void Histogram::start() {
+    if (this->job.active || !this->hasPending) {
+        return;
+    }
+    Job job = this->pending;
+    this->hasPending = false;
+
+    RenderGraph histogramGraph{};
+    histogramGraph.device = this->device;
+    RenderGraph::ResourceId source = histogramGraph.importImage(
+        "source", job.image, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    );
+    RenderGraph::ResourceId result = histogramGraph.importBuffer("result", this->resultBuffer);
+    RenderGraph::ResourceId readback = histogramGraph.importBuffer(
+        "readback", this->readbackBuffer, RenderGraph::ACCESS_HOST_READ
+    );
+    histogramGraph.addPass(
+        "clear",
+        {},
+        {{result, RenderGraph::ACCESS_TRANSFER_WRITE}},
+        [&](VkCommandBuffer commandBuffer, RenderGraph &graph) {
+            // bins and max start at 0, min at 1.0f
+            float one = 1.0f;
+            uint32_t oneBits;
+            std::memcpy(&oneBits, &one, sizeof(oneBits));
+            vkCmdFillBuffer(commandBuffer, this->resultBuffer, 0, sizeof(HistogramResult), 0);
+            vkCmdFillBuffer(
+                commandBuffer, this->resultBuffer, offsetof(HistogramResult, minBits),
+                sizeof(HistogramResult::minBits), oneBits
+            );
+        }
+    );
+    histogramGraph.addPass(
+        "histogram",
+        {{source, RenderGraph::ACCESS_COMPUTE_SAMPLED_READ}},
+        {{result, RenderGraph::ACCESS_COMPUTE_STORAGE_WRITE}},
+        [&](VkCommandBuffer commandBuffer, RenderGraph &graph) {
+            HistogramParams pushParams = {job.index};
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+            this->textures->bind(commandBuffer, this->pipelineLayout, VK_PIPELINE_BIND_POINT_COMPUTE);
+            vkCmdBindDescriptorSets(
+                commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 1, 1, &this->descriptorSet, 0, nullptr
+            );
+            vkCmdPushConstants(
+                commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HistogramParams), &pushParams
+            );
+            uint32_t groupsX = std::min((job.extent.width + HISTOGRAM_TILE - 1) / HISTOGRAM_TILE, HISTOGRAM_MAX_GROUPS);
+            uint32_t groupsY = std::min((job.extent.height + HISTOGRAM_TILE - 1) / HISTOGRAM_TILE, HISTOGRAM_MAX_GROUPS);
+            vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+        }
+    );
+    histogramGraph.addPass(
+        "readback",
+        {{result, RenderGraph::ACCESS_TRANSFER_READ}},
+        {{readback, RenderGraph::ACCESS_TRANSFER_WRITE}},
+        [&](VkCommandBuffer commandBuffer, RenderGraph &graph) {
+            VkBufferCopy region = {0, 0, sizeof(HistogramResult)};
+            vkCmdCopyBuffer(commandBuffer, this->resultBuffer, this->readbackBuffer, 1, &region);
+        }
+    );
+
+    vkResetCommandBuffer(this->commandBuffer, 0);
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (VK_SUCCESS != vkBeginCommandBuffer(this->commandBuffer, &beginInfo)) {
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
+    histogramGraph.execute(this->commandBuffer);
+    if (VK_SUCCESS != vkEndCommandBuffer(this->commandBuffer)) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+    this->dispatchCount++;
+
+    // the source may have been uploaded by a graphics submission that is still pending or running
+    uint64_t uploadValue = this->device->flushDeferredGraphics();
+    VkPipelineStageFlags uploadStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    uint64_t signalValue = ++this->timelineValue;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = uploadValue != 0 ? 1 : 0;
+    timelineInfo.pWaitSemaphoreValues = &uploadValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = uploadValue != 0 ? 1 : 0;
+    submitInfo.pWaitSemaphores = &this->device->graphicsTimeline;
+    submitInfo.pWaitDstStageMask = &uploadStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &this->commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &this->timeline;
+    {
+        std::lock_guard<std::mutex> queueLock(this->device->queueMutex(this->device->computeQueue));
+        if (VK_SUCCESS != vkQueueSubmit(this->device->computeQueue, 1, &submitInfo, VK_NULL_HANDLE)) {
+            throw std::runtime_error("failed to submit histogram command buffer!");
+        }
+    }
+
+    job.active = true;
+    job.timelineValue = signalValue;
+    this->job = job;
+
+    if (this->notify && nullptr != this->waiter) {
+        this->waiter->add(this->timeline, signalValue, this->notify);
+    }
+}
+
+bool Histogram::poll(Stats &stats) {
+    if (!this->job.active) {
+        return false;
+    }
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(this->device->device, this->timeline, &value);
+    if (value < this->job.timelineValue) {
+        return false;
+    }
+
+    const HistogramResult *result = static_cast<const HistogramResult*>(this->readbackData);
+    stats = Stats{};
+    stats.image = this->job.image;
+    for (uint32_t channel = 0; channel < CHANNEL_COUNT; channel++) {
+        uint64_t count = 0;
+        double sum = 0.0;
+        for (uint32_t bin = 0; bin < BIN_COUNT; bin++) {
+            uint32_t binCount = result->bins[channel * BIN_COUNT + bin];
+            stats.bins[channel][bin] = binCount;
+            count += binCount;
+            sum += static_cast<double>(binCount) * bin / (BIN_COUNT - 1);
+        }
+        stats.pixelCount = count;
+        stats.mean[channel] = count > 0 ? static_cast<float>(sum / count) : 0.0f;
+        std::memcpy(&stats.min[channel], &result->minBits[channel], sizeof(float));
+        std::memcpy(&stats.max[channel], &result->maxBits[channel], sizeof(float));
+    }
+
+    this->job = {};
+    start();
+    return true;
+}
+
+void Histogram::release(VkImage image) {
+    if (this->hasPending && this->pending.image == image) {
+        this->hasPending = false;
+    }
+    if (!this->job.active || this->job.image != image) return;
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &this->timeline;
+    waitInfo.pValues = &this->job.timelineValue;
+    vkWaitSemaphores(this->device->device, &waitInfo, UINT64_MAX);
+}
+
+void Histogram::beforeWrite(VkImage image) {
+    if (!this->job.active || this->job.image != image) return;
+    this->device->addGraphicsWait(this->timeline, this->job.timelineValue, VK_PIPELINE_STAGE_TRANSFER_BIT);
+}
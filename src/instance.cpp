@@ -81,19 +81,21 @@ void Instance::parseExtensions (SDL_Window *window) {
         requiredExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
 
-    // get extensions required by SDL
-    uint32_t requiredBySdlExtensionsCount;
-    if (SDL_FALSE == SDL_Vulkan_GetInstanceExtensions(window, &requiredBySdlExtensionsCount, nullptr)) {
-        throw std::runtime_error("failed to get instance extensions from SDL");
-    }
+    // get extensions required by SDL (none in headless mode, there is no window)
+    if (nullptr != window) {
+        uint32_t requiredBySdlExtensionsCount;
+        if (SDL_FALSE == SDL_Vulkan_GetInstanceExtensions(window, &requiredBySdlExtensionsCount, nullptr)) {
+            throw std::runtime_error("failed to get instance extensions from SDL");
+        }
 
-    requiredExtensions.resize(requiredExtensions.size() + requiredBySdlExtensionsCount,nullptr);
-    if (SDL_FALSE == SDL_Vulkan_GetInstanceExtensions(
-        window,
-        &requiredBySdlExtensionsCount,
-        requiredExtensions.data() + (requiredExtensions.size() - requiredBySdlExtensionsCount)
-    )) {
-        throw std::runtime_error("failed to get instance extensions from SDL");
+        requiredExtensions.resize(requiredExtensions.size() + requiredBySdlExtensionsCount,nullptr);
+        if (SDL_FALSE == SDL_Vulkan_GetInstanceExtensions(
+            window,
+            &requiredBySdlExtensionsCount,
+            requiredExtensions.data() + (requiredExtensions.size() - requiredBySdlExtensionsCount)
+        )) {
+            throw std::runtime_error("failed to get instance extensions from SDL");
+        }
     }
 
     // dedupe requiredExtensions
@@ -210,7 +212,7 @@ void Instance::create(App *app) {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = VK_API_VERSION_1_3;
 
     //VkInstanceCreateInfo createInfo = this->InstanceCI;
     VkInstanceCreateInfo createInfo{};
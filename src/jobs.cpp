@@ -0,0 +1,238 @@
+#include "types.hpp"
+#include <cstdint>
+#include <cstdio>
+
+// Every worker has a deque of its own: jobs it submits go to the back and it takes them from
+// there, the most recent first while their data is still in its cache. A worker that runs dry
+// steals from the front of the others', the oldest jobs, which tend to be the big ones. The
+// deques have a mutex each, a steal only contends with the one owner.
+
+static thread_local JobSystem *currentPool = nullptr;
+static thread_local int32_t currentWorker = -1;
+
+void JobSystem::create(uint32_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    this->stopping = false;
+    this->queuedCount = 0;
+    this->createdAt = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < threadCount; i++) {
+        this->workers.push_back(std::make_unique<Worker>());
+    }
+    // the deques all exist before the first worker looks at them
+    for (uint32_t i = 0; i < threadCount; i++) {
+        this->workers[i]->thread = std::thread(&JobSystem::work, this, i);
+    }
+}
+
+void JobSystem::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(this->sleepMutex);
+        this->stopping = true;
+    }
+    this->jobQueued.notify_all();
+    for (std::unique_ptr<Worker> &worker : this->workers) {
+        worker->thread.join();
+    }
+    this->workers.clear();
+}
+
+// ######
+//  JOBS
+// ######
+
+JobSystem::Handle JobSystem::submit(std::function<void()> work, const std::vector<Handle> &dependencies) {
+    Handle job = std::make_shared<Job>();
+    job->work = std::move(work);
+    // held until every dependency is linked, so one finishing meanwhile can't queue it early
+    job->waitingFor = 1;
+    for (const Handle &dependency : dependencies) {
+        if (nullptr == dependency) continue;
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (!dependency->done) {
+            dependency->dependents.push_back(job);
+            job->waitingFor++;
+        }
+    }
+    if (--job->waitingFor == 0) {
+        enqueue(job);
+    }
+    return job;
+}
+
+void JobSystem::enqueue(const Handle &job) {
+    if (this->workers.empty()) {
+        execute(job, -1, false);
+        return;
+    }
+    // a worker keeps what it submits, everybody else spreads it over the workers
+    uint32_t target = currentPool == this ? static_cast<uint32_t>(currentWorker)
+                                          : this->nextWorker++ % this->threadCount();
+    {
+        std::lock_guard<std::mutex> lock(this->workers[target]->mutex);
+        this->workers[target]->jobs.push_back(job);
+    }
+    this->queuedCount++;
+    {
+        std::lock_guard<std::mutex> lock(this->sleepMutex);
+    }
+    this->jobQueued.notify_one();
+    this->progress.notify_all();
+}
+
+bool JobSystem::runOne(int32_t self) {
+    Handle job = nullptr;
+    bool stolen = false;
+    if (self >= 0) {
+        Worker &own = *this->workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+        }
+    }
+    uint32_t count = this->threadCount();
+    for (uint32_t i = 0; nullptr == job && i < count; i++) {
+        uint32_t victim = (static_cast<uint32_t>(self + 1) + i) % count;
+        if (static_cast<int32_t>(victim) == self) continue;
+        Worker &other = *this->workers[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.jobs.empty()) {
+            job = std::move(other.jobs.front());
+            other.jobs.pop_front();
+            stolen = self >= 0;
+        }
+    }
+    if (nullptr == job) {
+        return false;
+    }
+    this->queuedCount--;
+    execute(job, self, stolen);
+    return true;
+}
+
+void JobSystem::execute(const Handle &job, int32_t self, bool stolen) {
+    auto start = std::chrono::steady_clock::now();
+    try {
+        job->work();
+    } catch (...) {
+        job->error = std::current_exception();
+    }
+    job->work = nullptr;    // whatever it captured goes now
+    auto end = std::chrono::steady_clock::now();
+    if (self >= 0) {
+        Worker &worker = *this->workers[self];
+        worker.busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        worker.jobCount++;
+        if (stolen) worker.stolenCount++;
+    }
+
+    std::vector<Handle> dependents = {};
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done = true;
+        dependents.swap(job->dependents);
+    }
+    for (const Handle &dependent : dependents) {
+        if (--dependent->waitingFor == 0) {
+            enqueue(dependent);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->sleepMutex);
+    }
+    this->progress.notify_all();
+}
+
+bool JobSystem::isDone(const Handle &job) {
+    std::lock_guard<std::mutex> lock(job->mutex);
+    return job->done;
+}
+
+void JobSystem::wait(const Handle &job) {
+    if (nullptr == job) return;
+    int32_t self = currentPool == this ? currentWorker : -1;
+    while (!isDone(job)) {
+        if (runOne(self)) continue;
+        std::unique_lock<std::mutex> lock(this->sleepMutex);
+        this->progress.wait(lock, [this, &job] { return this->queuedCount > 0 || this->isDone(job); });
+    }
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+void JobSystem::parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &body) {
+    grain = std::max<size_t>(1, grain);
+    std::vector<Handle> chunks = {};
+    for (size_t begin = grain; begin < count; begin += grain) {
+        size_t end = std::min(count, begin + grain);
+        chunks.push_back(submit([&body, begin, end]() { body(begin, end); }));
+    }
+    // the first chunk is the caller's; body has to outlive every chunk, even if one throws
+    std::exception_ptr error = nullptr;
+    try {
+        body(0, std::min(count, grain));
+    } catch (...) {
+        error = std::current_exception();
+    }
+    for (const Handle &chunk : chunks) {
+        try {
+            wait(chunk);
+        } catch (...) {
+            if (!error) error = std::current_exception();
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void JobSystem::work(uint32_t index) {
+    currentPool = this;
+    currentWorker = static_cast<int32_t>(index);
+    while (true) {
+        if (runOne(static_cast<int32_t>(index))) continue;
+        std::unique_lock<std::mutex> lock(this->sleepMutex);
+        this->jobQueued.wait(lock, [this] { return this->stopping || this->queuedCount > 0; });
+        if (this->stopping && this->queuedCount == 0) {
+            return; // stopping and drained
+        }
+    }
+}
+
+// #######
+//  STATS
+// #######
+
+std::vector<JobSystem::WorkerStats> JobSystem::stats() {
+    std::vector<WorkerStats> result(this->workers.size());
+    for (size_t i = 0; i < this->workers.size(); i++) {
+        result[i].busyNs = this->workers[i]->busyNs;
+        result[i].jobCount = this->workers[i]->jobCount;
+        result[i].stolenCount = this->workers[i]->stolenCount;
+    }
+    return result;
+}
+
+void JobSystem::report() {
+    std::vector<WorkerStats> workerStats = this->stats();
+    uint64_t jobCount = 0, stolenCount = 0, busyNs = 0;
+    for (const WorkerStats &worker : workerStats) {
+        jobCount += worker.jobCount;
+        stolenCount += worker.stolenCount;
+        busyNs += worker.busyNs;
+    }
+    if (jobCount == 0) return;
+    double wallNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - this->createdAt).count();
+    std::cout << "jobs: " << jobCount << " on " << workerStats.size() << " workers (" << stolenCount << " stolen), "
+              << 100.0 * busyNs / (wallNs * workerStats.size()) << "% busy overall" << std::endl;
+    for (size_t i = 0; i < workerStats.size(); i++) {
+        char line[96];
+        snprintf(line, sizeof(line), "jobs:   worker %2zu: %5.1f%% busy, %6llu jobs, %6llu stolen", i,
+                 100.0 * workerStats[i].busyNs / wallNs, static_cast<unsigned long long>(workerStats[i].jobCount),
+                 static_cast<unsigned long long>(workerStats[i].stolenCount));
+        std::cout << line << std::endl;
+    }
+}
@@ -3,82 +3,552 @@
 #include "types.hpp"
 #include <SDL2/SDL_video.h>
 #include <vulkan/vulkan_core.h>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// black and white points at the 0.1% and 99.9% percentiles of the unadjusted image, over R, G
+// and B together so the colour balance stays; levels come after exposure and contrast, so the
+// points go through those first
+void applyAutoLevels(App *app) {
+    const Histogram::Stats &stats = app->sourceStats;
+    float black = 1.0f;
+    float white = 0.0f;
+    for (Histogram::Channel channel : {Histogram::CHANNEL_RED, Histogram::CHANNEL_GREEN, Histogram::CHANNEL_BLUE}) {
+        black = std::min(black, stats.percentile(channel, 0.001f));
+        white = std::max(white, stats.percentile(channel, 0.999f));
+    }
+    if (white <= black) return;
+
+    Adjuster::Params &adjustments = app->adjustments;
+    auto toLevelsInput = [&adjustments](float encoded) {
+        float linear = encoded <= 0.04045f ? encoded / 12.92f : std::pow((encoded + 0.055f) / 1.055f, 2.4f);
+        return 0.18f * std::pow(linear * std::exp2(adjustments.exposure) / 0.18f, adjustments.contrast);
+    };
+    adjustments.black = toLevelsInput(black);
+    adjustments.white = toLevelsInput(white);
+    std::cout << "levels: black " << adjustments.black << ", white " << adjustments.white << std::endl;
+}
+
+void printStats(const Histogram::Stats &stats) {
+    if (stats.pixelCount == 0) return;
+    const char *names[Histogram::CHANNEL_COUNT] = {"R", "G", "B", "luma"};
+    for (uint32_t channel = 0; channel < Histogram::CHANNEL_COUNT; channel++) {
+        Histogram::Channel c = static_cast<Histogram::Channel>(channel);
+        std::cout << "histogram: " << names[channel] << " min " << stats.min[channel] << ", max " << stats.max[channel]
+                  << ", mean " << stats.mean[channel] << ", p1 " << stats.percentile(c, 0.01f)
+                  << ", p50 " << stats.percentile(c, 0.5f) << ", p99 " << stats.percentile(c, 0.99f) << std::endl;
+    }
+}
+
+// source -> Adjuster (async compute) -> Downscaler -> drawn; big textures are drawn from a copy
+// filtered down to their on-screen size, redone when the zoom or the adjusted image changes.
+// What is shown gets measured by the Histogram, also on the compute queue. A new texture only
+// damages the image's rect on screen
+void updateDisplayTexture(App *app) {
+    if (app->grid) return;
+    bool adjusted = app->adjuster.poll();
+    if (adjusted) {
+        std::pair<VkImage, uint32_t> adjusted = app->adjuster.result();
+        app->downscaler.setSource(adjusted.first, adjusted.second);
+        app->histogram.request(adjusted.first, adjusted.second, app->adjuster.sourceExtent);
+    }
+    Histogram::Stats stats;
+    if (app->histogram.poll(stats)) {
+        if (stats.image == app->adjuster.sourceImage) {
+            app->sourceStats = stats;
+            if (app->autoLevels) {
+                app->autoLevels = false;
+                applyAutoLevels(app);
+                app->adjuster.request(app->adjustments);
+            }
+        }
+        if (stats.image == app->adjuster.result().first) {
+            app->shownStats = stats;
+        }
+    }
+    VkExtent2D displayExtent = app->model.displayExtent(app->swapchain.swapChainExtent, app->view.zoom);
+    uint32_t displayIndex = app->downscaler.update(displayExtent);
+    if (adjusted || displayIndex != app->model.displayIndex) {
+        app->renderer.damage(app->model.screenRect(app->swapchain.swapChainExtent, app->view.zoom, app->view.pan));
+    }
+    app->model.displayIndex = displayIndex;
+}
+
+// the model's draw style: the transparent parts of the image blended over the background, or its
+// color channels drawn opaque
+PipelineConf drawStyle(App *app, bool alphaBlend) {
+    PipelineConf conf = app->pipeline.pipelineConfig;
+    if (alphaBlend) {
+        conf.colorBlendAttachment.blendEnable = VK_TRUE;
+        conf.colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        conf.colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        conf.colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        conf.colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    }
+    return conf;
+}
+
+// --ingest: stands in for a producer process, the decoded texels in a memfd mapping that
+// Model::ingestHostPixels imports; nullptr if the device cannot import host memory
+void *openIngestSource(App *app, int &fd, VkDeviceSize &size) {
+    if (!app->device.hasExternalMemoryHost) {
+        std::cerr << "ingest: VK_EXT_external_memory_host is not supported, skipped" << std::endl;
+        return nullptr;
+    }
+    VkDeviceSize alignment = std::max<VkDeviceSize>(app->device.hostPointerAlignment, sysconf(_SC_PAGESIZE));
+    size = (app->model.stb_image.size + alignment - 1) / alignment * alignment;
+    fd = memfd_create("ingest", 0);
+    if (fd < 0 || 0 != ftruncate(fd, static_cast<off_t>(size))) {
+        throw std::runtime_error("failed to create the ingest memfd!");
+    }
+    void *pixels = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == pixels) {
+        throw std::runtime_error("failed to map the ingest memfd!");
+    }
+    std::memcpy(pixels, app->model.textureStagingData, app->model.stb_image.size);
+    return pixels;
+}
+
+void closeIngestSource(App *app, void *pixels, int fd, VkDeviceSize size) {
+    app->model.releaseHostPixels(pixels);
+    munmap(pixels, size);
+    close(fd);
+}
+
+void run_headless(App *app) {
+    // frames rendered before the measurement starts (pipeline warm-up, lazy driver allocations)
+    const uint32_t warmupFrames = std::min<uint32_t>(app->frameLimit / 10, 60);
+
+    int ingestFd = -1;
+    VkDeviceSize ingestSize = 0;
+    void *ingestPixels = app->ingest && !app->grid ? openIngestSource(app, ingestFd, ingestSize) : nullptr;
+
+    auto start = std::chrono::steady_clock::now();
+    auto steadyStart = start;
+    for (uint32_t frame = 0; frame < app->frameLimit; frame++) {
+        if (frame == warmupFrames) {
+            steadyStart = std::chrono::steady_clock::now();
+        }
+        if (nullptr != ingestPixels) {
+            // the memfd is never written again, the returned value need not be waited for
+            app->model.ingestHostPixels(ingestPixels, ingestSize);
+        }
+        updateDisplayTexture(app);
+        // measures whole frames
+        app->renderer.damageAll();
+        app->renderer.drawFrame();
+    }
+    vkDeviceWaitIdle(app->device.device);
+    auto end = std::chrono::steady_clock::now();
+    if (nullptr != ingestPixels) {
+        closeIngestSource(app, ingestPixels, ingestFd, ingestSize);
+        std::cout << "ingest: " << app->frameLimit << " uploads from shared memory, "
+                  << (ingestSize >> 20) << " MiB imported once" << std::endl;
+    }
+
+    double total = std::chrono::duration<double>(end - start).count();
+    double steady = std::chrono::duration<double>(end - steadyStart).count();
+    std::cout << "headless: " << app->frameLimit << " frames in " << total << " s" << std::endl;
+    if (steady > 0.0) {
+        std::cout << "headless: sustained " << (app->frameLimit - warmupFrames) / steady << " fps" << std::endl;
+    }
+}
+
+void run_batch(App *app) {
+    // Instance -> Device -> BatchProcessor, no swapchain and no graphics pipeline needed
+    app->instance.create(app);
+    app->device.pickPhysicalDevice(app);
+    app->device.create(app);
+    app->device.createCommandPool();
+
+    app->encoder.create(&(app->jobs));
+    app->batch.device = &(app->device);
+    app->batch.encoder = &(app->encoder);
+    app->batch.jobs = &(app->jobs);
+    app->batch.create();
+    app->batch.run();
+
+    vkDeviceWaitIdle(app->device.device);
+    app->batch.destroy();
+    app->batch.jobs = nullptr;
+    app->batch.encoder = nullptr;
+    app->batch.device = nullptr;
+    app->encoder.destroy();
+
+    app->device.destroyCommandPool();
+    app->device.destroy();
+    app->instance.destroy();
+}
+
+// mouse wheel zooms around the cursor, dragging with the left button pans, Home resets;
+// true if the view changed
+bool handleViewEvent(App *app, const SDL_Event &event) {
+    int width, height;
+    SDL_GetWindowSize(app->window, &width, &height);
+    if (width <= 0 || height <= 0) return false;
+
+    switch (event.type) {
+        case SDL_MOUSEWHEEL: {
+            int x, y;
+            SDL_GetMouseState(&x, &y);
+            glm::vec2 cursor = {2.0f * x / width - 1.0f, 2.0f * y / height - 1.0f};
+            app->view.zoomAt(cursor, std::pow(1.1f, static_cast<float>(event.wheel.y)));
+            return true;
+        }
+        case SDL_MOUSEMOTION:
+            if (event.motion.state & SDL_BUTTON_LMASK) {
+                app->view.panBy({2.0f * event.motion.xrel / width, 2.0f * event.motion.yrel / height});
+                return true;
+            }
+            break;
+        case SDL_KEYDOWN:
+            if (event.key.keysym.sym == SDLK_HOME) {
+                app->view.reset();
+                return true;
+            }
+            break;
+    }
+    return false;
+}
+
+// E exposure, C contrast, G gamma, S sharpening (with Shift: down), L auto levels, Backspace resets;
+// the result shows up once the compute job is done. True if the adjustments changed
+bool handleAdjustEvent(App *app, const SDL_Event &event) {
+    if (app->grid || event.type != SDL_KEYDOWN) return false;
+    Adjuster::Params &adjustments = app->adjustments;
+    float direction = (event.key.keysym.mod & KMOD_SHIFT) ? -1.0f : 1.0f;
+    switch (event.key.keysym.sym) {
+        case SDLK_e:
+            adjustments.exposure += 0.25f * direction;
+            break;
+        case SDLK_c:
+            adjustments.contrast *= std::pow(1.1f, direction);
+            break;
+        case SDLK_g:
+            adjustments.gamma *= std::pow(1.1f, direction);
+            break;
+        case SDLK_s:
+            adjustments.sharpen = std::max(0.0f, adjustments.sharpen + 0.25f * direction);
+            break;
+        case SDLK_l:
+            if (!app->histogram.supported) return false;
+            if (app->sourceStats.pixelCount == 0) {
+                // still being measured, updateDisplayTexture applies it
+                app->autoLevels = true;
+                return false;
+            }
+            applyAutoLevels(app);
+            break;
+        case SDLK_BACKSPACE:
+            adjustments = Adjuster::Params{};
+            break;
+        default:
+            return false;
+    }
+    app->adjuster.request(adjustments);
+    return true;
+}
 
 void run_app(App *app) {
     // window -> Instance -> Surface -> Device -> Swapchain ->
     // -> Pipeline -> Vertex Buffers -> Renderer
-    SDL_Init(SDL_INIT_VIDEO);
-    app->window = SDL_CreateWindow(
-        "hello-triangle",
-        SDL_WINDOWPOS_UNDEFINED,
-        SDL_WINDOWPOS_UNDEFINED,
-        1280,
-        720,
-        SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN
-    );
+    // headless: Instance -> Device -> offscreen images -> ...
+    // the image decodes as a job meanwhile (app->decoded), joined before the texture is created
+    if (!app->headless) {
+        app->startup.next("window");
+        SDL_Init(SDL_INIT_VIDEO);
+        app->window = SDL_CreateWindow(
+            "hello-triangle",
+            SDL_WINDOWPOS_UNDEFINED,
+            SDL_WINDOWPOS_UNDEFINED,
+            app->windowExtent.width,
+            app->windowExtent.height,
+            SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN
+        );
+    }
+    app->startup.next("instance");
     app->instance.create(app);
-    if (SDL_TRUE != SDL_Vulkan_CreateSurface(app->window,app->instance.instance,&(app->surface))) {
+    if (!app->headless &&
+        SDL_TRUE != SDL_Vulkan_CreateSurface(app->window,app->instance.instance,&(app->surface))) {
         throw std::runtime_error("failed to create the surface");
     }
+    app->startup.next("device");
     app->device.pickPhysicalDevice(app);
     app->device.create(app);
     app->device.createCommandPool();
     
+    app->startup.next("swapchain");
     app->swapchain.device = &(app->device);
-    app->swapchain.createSwapChain(app);
+    if (app->headless) {
+        app->swapchain.createOffscreenImages(app);
+    } else {
+        app->swapchain.createSwapChain(app);
+    }
     app->swapchain.createImageViews();
     app->swapchain.createRenderPass();
     app->swapchain.createDepthImagesViewsMemorys();
     app->swapchain.createFrameBuffers();
 
 
+    app->startup.next("texture heap");
+    app->textures.device = &(app->device);
+    app->textures.create();
+    if (app->grid) {
+        app->startup.next("thumbnails");
+        app->sheet.device = &(app->device);
+        app->sheet.create();
+        app->sheet.loadThumbnails(&(app->jobs));
+        app->sheet.layout(app->swapchain.swapChainExtent);
+        app->sheet.textureIndex = app->textures.allocate(TextureHeap::BINDING_2D_ARRAY, app->sheet.textureView);
+        app->pipeline.shaders = Pipeline::SHADERS_SHEET;
+    }
+    app->pipeline.setLayouts = {app->textures.descriptorSetLayout};
+    app->pipeline.addRenderPass(app->swapchain.renderpass, app->swapchain.attachments);
+    app->pipeline.addRenderPass(app->swapchain.renderpassPartial, app->swapchain.attachments);
+
+    app->startup.next("pipeline");
     app->pipeline.device = &(app->device);
     app->pipeline.createShaderModules();
     app->pipeline.createPipelineLayout();
     app->pipeline.writeDefaultPipelineConf(app->swapchain.swapChainExtent);
     app->pipeline.pipelineConfig.InputAssemblyCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP; // LIST | STRIP
     app->pipeline.pipelineConfig.RasterizationCI.cullMode = VK_CULL_MODE_BACK_BIT;
+    if (app->grid) {
+        app->pipeline.pipelineConfig.vertexBindings = ContactSheet::getVertexBindingDescriptions();
+        app->pipeline.pipelineConfig.vertexAttributes = ContactSheet::getVertexAttributeDescriptions();
+        app->pipeline.pipelineConfig.RasterizationCI.cullMode = VK_CULL_MODE_NONE;
+    }
+    if (app->swapchain.depthMode == SwapChain::DEPTH_NONE) {
+        app->pipeline.pipelineConfig.DepthStencilCI.depthTestEnable = VK_FALSE;
+        app->pipeline.pipelineConfig.DepthStencilCI.depthWriteEnable = VK_FALSE;
+    }
     app->pipeline.createPipeline(app->swapchain.renderpass);
+    if (!app->grid) {
+        // the other draw style is compiled ahead, so the first switch finds it ready
+        if (!app->headless) {
+            app->pipeline.notify = [app]() { app->scheduler.post(); };
+        }
+        app->pipeline.createCompiler(&(app->jobs));
+        app->pipeline.variantAsync(drawStyle(app, !app->alphaBlend), app->swapchain.renderpass, VK_NULL_HANDLE);
+    }
 
-    app->model.device = &(app->device);
-    //app->model.vertices = {{{0.0f, -0.5f}}, {{0.5f, 0.5f}}, {{-0.5f, 0.5f}}};
-    app->model.createTextureObjects();
-    app->model.createVertexBuffers(10);
-    app->model.vertices = {
-        {{ -0.5,  0.75}},
-        {{  0.0, -0.75}},
-        {{  0.5,  0.75}},
+    if (!app->grid) {
+        // the one point that needs both the device and the pixels
+        app->startup.next("wait for decode");
+        app->jobs.wait(app->decoded);
+        if (0 != app->decodeResult) {
+            throw std::runtime_error("failed to load the image!");
+        }
+        app->startup.next("texture upload");
+        app->model.device = &(app->device);
+        app->model.jobs = &(app->jobs);
+        //app->model.vertices = {{{0.0f, -0.5f}}, {{0.5f, 0.5f}}, {{-0.5f, 0.5f}}};
+        app->model.createTextureObjects();
+        app->model.createVertexBuffers(10);
+        app->model.vertices = {
+            {{ -0.5,  0.75}, {0.25,  0.875}},
+            {{  0.0, -0.75}, {0.5,   0.125}},
+            {{  0.5,  0.75}, {0.75,  0.875}},
 
-        //{{  0.0, -0.75}}, // culled without strip
-        //{{  0.5,  0.75}},
-        {{  0.75,-0.75}},
+            //{{  0.0, -0.75}}, // culled without strip
+            //{{  0.5,  0.75}},
+            {{  0.75,-0.75}, {0.875, 0.125}},
 
 
-        // if using STRIP, then triangles do not have alternating faces
-        // https://stackoverflow.com/questions/9154117/back-face-culling-gl-triangle-strip
-    };
-    //app->model.vertexCount = 3;
-    app->model.vertexCount = app->model.vertices.size();
-    app->model.writeVertexBuffers(app->model.vertices);
-    app->model.writeTextureToGPU();
+            // if using STRIP, then triangles do not have alternating faces
+            // https://stackoverflow.com/questions/9154117/back-face-culling-gl-triangle-strip
+        };
+        //app->model.vertexCount = 3;
+        app->model.vertexCount = app->model.vertices.size();
+        app->model.writeVertexBuffers(app->model.vertices);
+        app->model.writeTextureToGPU();
+        app->model.textureIndex = app->textures.allocate(TextureHeap::BINDING_2D, app->model.textureView);
+        app->model.displayIndex = app->model.textureIndex;
+
+        app->startup.next("compute setup");
+        app->downscaler.device = &(app->device);
+        app->downscaler.textures = &(app->textures);
+        app->downscaler.sourceImage = app->model.textureImage;
+        app->downscaler.sourceIndex = app->model.textureIndex;
+        app->downscaler.sourceExtent = {
+            static_cast<uint32_t>(app->model.stb_image.texWidth),
+            static_cast<uint32_t>(app->model.stb_image.texHeight)
+        };
+        app->downscaler.create();
 
+        app->waiter.device = &(app->device);
+        app->waiter.create();
+        app->histogram.device = &(app->device);
+        app->histogram.textures = &(app->textures);
+        app->histogram.waiter = &(app->waiter);
+        if (!app->headless) {
+            app->histogram.notify = [app]() { app->scheduler.post(); };
+        }
+        app->histogram.create();
+        app->histogram.request(app->model.textureImage, app->model.textureIndex, app->downscaler.sourceExtent);
+
+        app->adjuster.device = &(app->device);
+        app->adjuster.textures = &(app->textures);
+        app->adjuster.waiter = &(app->waiter);
+        app->adjuster.sourceImage = app->downscaler.sourceImage;
+        app->adjuster.sourceIndex = app->downscaler.sourceIndex;
+        app->adjuster.sourceExtent = app->downscaler.sourceExtent;
+        if (!app->headless) {
+            app->adjuster.notify = [app]() { app->scheduler.post(); };
+        }
+        app->adjuster.releaseImage = [app](VkImage image) { app->histogram.release(image); };
+        app->model.beforeIngest = [app]() {
+            app->adjuster.beforeSourceWrite();
+            app->histogram.beforeWrite(app->model.textureImage);
+        };
+        app->adjuster.create();
+        app->adjuster.request(app->adjustments);
+        updateDisplayTexture(app);
+    }
+
+    app->startup.next("renderer");
     app->renderer.device = &(app->device);
     app->renderer.swapchain = &(app->swapchain);
     app->renderer.pipeline = app->pipeline.pipeline;
+    app->renderer.pipelineLayout = app->pipeline.pipelineLayout;
+    app->renderer.textures = &(app->textures);
     app->renderer.pipelineBindType = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    app->renderer.offscreen = app->headless;
     app->renderer.createSemaphoresFences();
+    app->presenter.device = &(app->device);
+    app->presenter.threaded = app->presenter.threaded && !app->headless;
+    app->presenter.create();
+    app->renderer.presenter = &(app->presenter);
+
+    app->encoder.create(&(app->jobs));
+    app->readback.device = &(app->device);
+    app->readback.swapchain = &(app->swapchain);
+    app->readback.encoder = &(app->encoder);
+    app->readback.create();
+    app->renderer.readback = &(app->readback);
     app->renderer.createCommandBuffers();
-    app->renderer.recordCommandBuffers(&app->model);
+    app->renderer.view = &(app->view);
+    if (app->grid) {
+        app->renderer.setContents(&app->sheet);
+    } else {
+        app->renderer.setContents(&app->model);
+    }
+    app->startup.finish();
+    app->startup.report();
 
-    bool running = true;
+    if (app->headless) {
+        run_headless(app);
+    }
+    bool running = !app->headless;
+    uint32_t frame = 0;
+    if (running) {
+        app->scheduler.create();
+    }
     while(running) {
         SDL_Event windowEvent;
-        while(SDL_PollEvent(&windowEvent))
+        bool hasEvent = app->scheduler.waitEvent(windowEvent);
+        while(hasEvent) {
             if(windowEvent.type == SDL_QUIT) {
                 running = false;
                 break;
             }
+            if (windowEvent.type == SDL_KEYDOWN && windowEvent.key.keysym.sym == SDLK_F12) {
+                app->readback.captureNext = true;
+                app->scheduler.invalidate();
+            }
+            if (windowEvent.type == SDL_KEYDOWN && windowEvent.key.keysym.sym == SDLK_h && !app->grid) {
+                printStats(app->shownStats);
+            }
+            if (windowEvent.type == SDL_KEYDOWN && windowEvent.key.keysym.sym == SDLK_a && !app->grid) {
+                // another pipeline; until it is compiled the old style stays on screen
+                app->alphaBlend = !app->alphaBlend;
+                app->drawStylePending = true;
+            }
+            if (windowEvent.type == SDL_KEYDOWN && windowEvent.key.keysym.sym == SDLK_F11) {
+                // next present policy, only the swapchain and its per-image objects are rebuilt
+                app->swapchain.presentPolicy = static_cast<SwapChain::PresentPolicy>(
+                    (app->swapchain.presentPolicy + 1) % SwapChain::PRESENT_POLICY_COUNT);
+                app->presenter.wait();
+                app->swapchain.recreateSwapChain(app);
+                app->renderer.swapChainRecreated();
+                std::cout << "present: " << SwapChain::presentModeName(app->swapchain.presentMode) << ", "
+                          << app->swapchain.imageCount << " images" << std::endl;
+                // the new images start out damaged
+                app->scheduler.invalidate();
+            }
+            if (windowEvent.type == SDL_WINDOWEVENT && (
+                windowEvent.window.event == SDL_WINDOWEVENT_EXPOSED ||
+                windowEvent.window.event == SDL_WINDOWEVENT_SHOWN ||
+                windowEvent.window.event == SDL_WINDOWEVENT_RESTORED ||
+                windowEvent.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)) {
+                app->renderer.damageAll();
+                app->scheduler.invalidate();
+            }
+            if (app->scheduler.isWakeEvent(windowEvent)) {
+                app->scheduler.invalidate();
+            }
+            if (handleViewEvent(app, windowEvent)) {
+                app->renderer.damageAll();
+                app->scheduler.invalidate();
+            }
+            handleAdjustEvent(app, windowEvent);
+            hasEvent = SDL_PollEvent(&windowEvent);
+        }
+        if (!running) break;
+        if (app->drawStylePending) {
+            // woken up by Pipeline::notify once the compile is done
+            VkPipeline pipeline = app->pipeline.variantAsync(
+                drawStyle(app, app->alphaBlend), app->swapchain.renderpass, VK_NULL_HANDLE);
+            if (pipeline != VK_NULL_HANDLE) {
+                app->renderer.pipeline = pipeline;
+                app->drawStylePending = false;
+                app->renderer.damageAll();
+                app->scheduler.invalidate();
+            }
+        }
+        if (!app->scheduler.needsFrame()) {
+            // woken up by an event that changed nothing or by the timeout
+            app->readback.poll();
+            continue;
+        }
+        updateDisplayTexture(app);
+        if (app->scheduler.continuous) {
+            app->renderer.damageAll();
+        }
+        if (!app->renderer.hasDamage() && !app->readback.captureNext) {
+            // e.g. a histogram finished, nothing on screen changed
+            app->scheduler.frameSkipped();
+            continue;
+        }
         app->renderer.drawFrame();
+        app->scheduler.framePresented();
+        if (app->frameLimit != 0 && ++frame >= app->frameLimit) {
+            running = false;
+        }
+    }
+    app->presenter.destroy();
+    if (!app->headless) {
+        app->scheduler.report();
+        if (app->renderer.partialRedraw && app->renderer.framePixels > 0) {
+            std::cout << "damage: " << 100.0 * app->renderer.drawnPixels / app->renderer.framePixels
+                      << "% of the pixels redrawn"
+                      << (app->device.hasIncrementalPresent ? ", incremental present" : "") << std::endl;
+        }
+        if (app->presenter.presentCount > 0) {
+            std::cout << "present: " << app->presenter.presentCount << " frames, "
+                      << app->presenter.presentMs << " ms blocked in vkQueuePresentKHR";
+            if (app->presenter.threaded) {
+                std::cout << " on the present thread, the main thread waited " << app->presenter.waitMs
+                          << " ms for it";
+            } else {
+                std::cout << " on the main thread";
+            }
+            std::cout << std::endl;
+        }
     }
 
     //if (!SDL_Vulkan_DestroySurface(app->window,app->surface)) {
@@ -86,34 +556,111 @@ void run_app(App *app) {
     //}
     
     vkDeviceWaitIdle(app->device.device);
+    // what was replaced while running, before the heap and pools it refers to go
+    app->device.collectRetired(true);
+
+    app->readback.flush();
+    app->encoder.destroy();
+    if (app->readback.capturedCount + app->readback.droppedCount > 0) {
+        std::cout << "readback: " << app->readback.capturedCount << " frames captured, "
+                  << app->readback.droppedCount << " dropped" << std::endl;
+    }
+    app->renderer.readback = nullptr;
+    app->renderer.presenter = nullptr;
+    app->presenter.device = nullptr;
+    app->readback.destroy();
+    app->readback.encoder = nullptr;
+    app->readback.swapchain = nullptr;
+    app->readback.device = nullptr;
 
     app->renderer.destroyCommandBuffers();
     app->renderer.destroySemaphoresFences();
     app->renderer.swapchain = nullptr;
+    app->renderer.textures = nullptr;
+    app->renderer.view = nullptr;
     app->renderer.device = nullptr;
 
-    app->model.destroyVertexBuffers();
-    app->model.destroyTextureObjects();
+    if (app->grid) {
+        app->textures.release(TextureHeap::BINDING_2D_ARRAY, app->sheet.textureIndex);
+        app->sheet.destroy();
+        app->sheet.device = nullptr;
+    } else {
+        app->downscaler.destroy();
+        app->downscaler.textures = nullptr;
+        app->downscaler.device = nullptr;
+        app->histogram.destroy();
+        if (app->histogram.dispatchCount > 0) {
+            std::cout << "histogram: " << app->histogram.dispatchCount << " images measured" << std::endl;
+        }
+        app->histogram.notify = nullptr;
+        app->histogram.waiter = nullptr;
+        app->histogram.textures = nullptr;
+        app->histogram.device = nullptr;
+        app->adjuster.destroy();
+        if (app->adjuster.dispatchCount + app->adjuster.cacheHitCount > 0) {
+            std::cout << "adjust: " << app->adjuster.dispatchCount << " stages dispatched, "
+                      << app->adjuster.cacheHitCount << " served from the cache"
+                      << (app->device.hasAsyncCompute() ? " (async compute queue)" : " (graphics queue)") << std::endl;
+        }
+        app->adjuster.notify = nullptr;
+        app->adjuster.waiter = nullptr;
+        app->adjuster.releaseImage = nullptr;
+        app->waiter.destroy();
+        app->waiter.device = nullptr;
+        app->adjuster.textures = nullptr;
+        app->adjuster.device = nullptr;
+        app->textures.release(TextureHeap::BINDING_2D, app->model.textureIndex);
+        app->model.destroyVertexBuffers();
+        app->model.destroyTextureObjects();
+    }
 
+    if (!app->grid) {
+        app->pipeline.destroyCompiler();
+        app->pipeline.notify = nullptr;
+    }
+    if (app->pipeline.variantsReused > 0) {
+        std::cout << "pipelines: " << app->pipeline.variantsCreated << " variants compiled ("
+                  << app->pipeline.variantsInBackground << " in the background), "
+                  << app->pipeline.variantsReused << " requests served from the cache" << std::endl;
+    }
     app->pipeline.destroyPipeline();
     app->pipeline.destroyPipelineLayout();
     app->pipeline.destroyShaderModules ();
     app->pipeline.device = nullptr;
 
+    app->textures.destroy();
+    app->textures.device = nullptr;
+
     app->swapchain.destroyFrameBuffers();
     app->swapchain.destroyDepthImagesViewsMemorys();
     app->swapchain.destroyRenderPass();
     app->swapchain.destroyImageViews();
-    app->swapchain.destroySwapChain();
+    if (app->headless) {
+        app->swapchain.destroyOffscreenImages();
+    } else {
+        app->swapchain.destroySwapChain();
+    }
     app->swapchain.device = nullptr;
     
+    if (app->device.deferredCommandCount > 0) {
+        std::cout << "submit: " << app->device.graphicsSubmitCount << " graphics queue submissions, "
+                  << app->device.deferredCommandCount << " uploads batched into them" << std::endl;
+    }
+    if (app->device.retiredCount > 0) {
+        std::cout << "retire: " << app->device.retiredCount
+                  << " objects destroyed through the deferred deletion queue" << std::endl;
+    }
     app->device.destroyCommandPool();
     app->device.destroy();
-    vkDestroySurfaceKHR(app->instance.instance, app->surface, nullptr);
+    if (!app->headless) {
+        vkDestroySurfaceKHR(app->instance.instance, app->surface, nullptr);
+    }
     app->instance.destroy();
     //vkDestroyInstance(vkInst, nullptr);
-    SDL_DestroyWindow(app->window);
-    SDL_Quit();
+    if (!app->headless) {
+        SDL_DestroyWindow(app->window);
+        SDL_Quit();
+    }
     return;
 }
 
@@ -121,19 +668,160 @@ int main(int argc, char* argv[]) {
     App app{};
     debug = true;
 
-    if (argc > 1) {
-        app.model.stb_image.path = argv[1];
-    } else {
+    // main [--headless | --ingest] [--frames N] [--extent WxH] [--depth none|shared|per-image] path/to/image
+    //      [--grid [--cell WxH]] more/images...
+    //      [--downscale none|box|lanczos]
+    //      [--exposure STOPS] [--contrast C] [--levels B,W[,G]] [--curve x:y,...] [--sharpen AMOUNT] [--auto-levels]
+    //      [--continuous] [--present low-latency|vsync|max-throughput] [--fps-cap N] [--full-redraw]
+    //      [--present-thread]
+    //      [--capture | --screenshot] [--capture-dir DIR] [--capture-format png|jpg|raw]
+    // main --batch OUTDIR [--thumb WxH] [--format png|jpg|raw] images...
+    // [--threads N] in every mode, 0 - one per core
+    bool batch = false;
+    std::vector<std::string> paths = {};
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--batch" && i + 1 < argc) {
+            batch = true;
+            app.batch.outputDir = argv[++i];
+        } else if (arg == "--thumb" && i + 1 < argc) {
+            if (2 != std::sscanf(argv[++i], "%ux%u", &app.batch.maxExtent.width, &app.batch.maxExtent.height)) {
+                std::cerr << "Thumbnail size must be given as WIDTHxHEIGHT!" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--threads" && i + 1 < argc) {
+            app.jobThreads = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--format" && i + 1 < argc) {
+            if (!ImageEncoder::parseFormat(argv[++i], app.batch.format)) {
+                std::cerr << "Unknown output format " << argv[i] << "!" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--capture") {
+            app.readback.captureAll = true;
+        } else if (arg == "--screenshot") {
+            app.readback.captureNext = true;
+        } else if (arg == "--capture-dir" && i + 1 < argc) {
+            app.readback.outputDir = argv[++i];
+        } else if (arg == "--capture-format" && i + 1 < argc) {
+            if (!ImageEncoder::parseFormat(argv[++i], app.readback.format)) {
+                std::cerr << "Unknown capture format " << argv[i] << "!" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--depth" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "none") {
+                app.swapchain.depthMode = SwapChain::DEPTH_NONE;
+            } else if (mode == "shared") {
+                app.swapchain.depthMode = SwapChain::DEPTH_SHARED;
+            } else if (mode == "per-image") {
+                app.swapchain.depthMode = SwapChain::DEPTH_PER_IMAGE;
+            } else {
+                std::cerr << "Depth mode must be one of none, shared, per-image!" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--grid") {
+            app.grid = true;
+        } else if (arg == "--cell" && i + 1 < argc) {
+            if (2 != std::sscanf(argv[++i], "%ux%u", &app.sheet.cellExtent.width, &app.sheet.cellExtent.height)) {
+                std::cerr << "Cell size must be given as WIDTHxHEIGHT!" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--continuous") {
+            app.scheduler.continuous = true;
+        } else if (arg == "--present-thread") {
+            app.presenter.threaded = true;
+        } else if (arg == "--full-redraw") {
+            app.renderer.partialRedraw = false;
+        } else if (arg == "--downscale" && i + 1 < argc) {
+            if (!Downscaler::parseFilter(argv[++i], app.downscaler.filter)) {
+                std::cerr << "Downscale filter must be one of none, box, lanczos!" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--exposure" && i + 1 < argc) {
+            app.adjustments.exposure = std::strtof(argv[++i], nullptr);
+        } else if (arg == "--contrast" && i + 1 < argc) {
+            app.adjustments.contrast = std::strtof(argv[++i], nullptr);
+        } else if (arg == "--levels" && i + 1 < argc) {
+            if (2 > std::sscanf(argv[++i], "%f,%f,%f",
+                    &app.adjustments.black, &app.adjustments.white, &app.adjustments.gamma)) {
+                std::cerr << "Levels must be given as BLACK,WHITE[,GAMMA]!" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--curve" && i + 1 < argc) {
+            if (!Adjuster::parseCurve(argv[++i], app.adjustments.curve)) {
+                std::cerr << "Curve must be given as x:y,x:y,... with x in [0, 1]!" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--sharpen" && i + 1 < argc) {
+            app.adjustments.sharpen = std::strtof(argv[++i], nullptr);
+        } else if (arg == "--auto-levels") {
+            app.autoLevels = true;
+        } else if (arg == "--present" && i + 1 < argc) {
+            if (!SwapChain::parsePresentPolicy(argv[++i], app.swapchain.presentPolicy)) {
+                std::cerr << "Present policy must be one of low-latency, vsync, max-throughput!" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--fps-cap" && i + 1 < argc) {
+            app.scheduler.fpsCap = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--headless") {
+            app.headless = true;
+        } else if (arg == "--ingest") {
+            app.headless = true;
+            app.ingest = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            app.frameLimit = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--extent" && i + 1 < argc) {
+            if (2 != std::sscanf(argv[++i], "%ux%u", &app.windowExtent.width, &app.windowExtent.height)) {
+                std::cerr << "Extent must be given as WIDTHxHEIGHT!" << std::endl;
+                return 1;
+            }
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) {
         std::cerr << "No image path provided!" << std::endl;
         return 1;
     }
-    int retcode = app.model.loadImageSTBI();
-    if (0 != retcode) {
+    // every subsystem's CPU work goes to the one pool
+    app.jobs.create(app.jobThreads);
+    if (batch) {
+        app.headless = true;
+        app.batch.inputs = std::move(paths);
+        run_batch(&app);
+        app.jobs.report();
+        app.jobs.destroy();
+        return 0;
+    }
+    if (app.headless && app.frameLimit == 0) {
+        app.frameLimit = 1000;
+    }
+    app.startup.start();
+    if (app.grid || paths.size() > 1) {
+        app.grid = true;
+        app.sheet.paths = std::move(paths);
+        run_app(&app);
+        app.jobs.report();
+        app.jobs.destroy();
+        return 0;
+    }
+    app.model.stb_image.path = paths[0];
+    // only the header here, so a path that is no image still fails before any window shows up;
+    // the pixels are decoded while run_app brings Vulkan up
+    int width, height, channels;
+    if (!stbi_info(paths[0].c_str(), &width, &height, &channels)) {
         std::cerr << "Failed to load the image!" << std::endl;
+        app.jobs.destroy();
         return 1;
     }
-
+    app.decoded = app.jobs.submit([&app]() {
+        uint32_t phase = app.startup.begin("decode");
+        app.decodeResult = app.model.loadImageSTBI();
+        app.startup.end(phase);
+    });
 
     run_app(&app);
+    app.jobs.report();
+    app.jobs.destroy();
     return 0;
 }
@@ -3,27 +3,167 @@
 #include <cstdint>
 #include <algorithm>
 #include <cstring>
+#include <cmath>
+#include <limits>
+#include <glm/gtc/packing.hpp>
 #include <vulkan/vulkan_core.h>
 
-int Model::loadImageSTBI() {
+// 8 bit images go up as they are, into an sRGB format that decodes on sampling. Deeper ones are
+// converted while being written into the staging buffer, to linear values in the most compact
+// format that keeps their precision: 16 bit sRGB into RGBA16F (half floats have ~11 bits at every
+// magnitude, more than 16 bit sRGB has in the darks), HDR into a 32 bit packed float format.
+// Normalized 10 bit formats (A2B10G10R10) would need the sRGB decode in every shader that samples.
 
-    this->stb_image.pixels = stbi_load(
-        (this->stb_image.path.c_str()), 
-        &(this->stb_image.texWidth),
-        &(this->stb_image.texHeight),
-        &(this->stb_image.texChannels),
-        STBI_rgb_alpha
-    );
+int Model::loadImageSTBI() {
+    const char *path = this->stb_image.path.c_str();
+    if (stbi_is_hdr(path)) {
+        // Radiance files have no alpha
+        this->stb_image.depth = StbImage::DEPTH_FLOAT;
+        this->stb_image.pixels = stbi_loadf(
+            path, &(this->stb_image.texWidth), &(this->stb_image.texHeight), &(this->stb_image.texChannels), STBI_rgb
+        );
+    } else if (stbi_is_16_bit(path)) {
+        this->stb_image.depth = StbImage::DEPTH_16;
+        this->stb_image.pixels = stbi_load_16(
+            path, &(this->stb_image.texWidth), &(this->stb_image.texHeight), &(this->stb_image.texChannels), STBI_rgb_alpha
+        );
+    } else {
+        this->stb_image.depth = StbImage::DEPTH_8;
+        this->stb_image.pixels = stbi_load(
+            path, &(this->stb_image.texWidth), &(this->stb_image.texHeight), &(this->stb_image.texChannels), STBI_rgb_alpha
+        );
+    }
     if (nullptr == this->stb_image.pixels) {
         return 1;
     }
+    return 0;
+}
 
-    this->stb_image.size = this->stb_image.texWidth * this->stb_image.texHeight * 4;
+// sampled and uploaded to is all a texture needs
+VkFormat Model::chooseTextureFormat() {
+    VkFormatFeatureFlags features = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+    switch (this->stb_image.depth) {
+        case StbImage::DEPTH_16:
+            return this->device->findSupportedFormat(
+                {VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT}, VK_IMAGE_TILING_OPTIMAL, features
+            );
+        case StbImage::DEPTH_FLOAT:
+            // 4 bytes a texel either way; the shared exponent one has 9 mantissa bits for every channel
+            return this->device->findSupportedFormat(
+                {
+                    VK_FORMAT_E5B9G9R9_UFLOAT_PACK32,
+                    VK_FORMAT_B10G11R11_UFLOAT_PACK32,
+                    VK_FORMAT_R16G16B16A16_SFLOAT,
+                    VK_FORMAT_R32G32B32A32_SFLOAT
+                },
+                VK_IMAGE_TILING_OPTIMAL,
+                features
+            );
+        case StbImage::DEPTH_8:
+            break;
+    }
+    return VK_FORMAT_R8G8B8A8_SRGB;
+}
 
-    return 0;
+static uint32_t texelSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            return 4;
+    }
+}
+
+static const size_t TEXEL_CHUNK = 1 << 18;     // texels per job
+
+// convert over the texel range [0, count), in chunks on the job system if there is one
+static void forTexels(JobSystem *jobs, size_t count, const std::function<void(size_t begin, size_t end)> &convert) {
+    if (nullptr == jobs) {
+        convert(0, count);
+        return;
+    }
+    jobs->parallelFor(count, TEXEL_CHUNK, convert);
+}
+
+// pixels -> texels of format, 16 bit values through a lookup table of their linear values
+static void writeTexels(const StbImage &image, VkFormat format, void *dst, JobSystem *jobs) {
+    size_t count = static_cast<size_t>(image.texWidth) * image.texHeight;
+    if (image.depth == StbImage::DEPTH_8) {
+        forTexels(jobs, count, [&](size_t begin, size_t end) {
+            memcpy(static_cast<uint8_t*>(dst) + begin * 4, static_cast<const uint8_t*>(image.pixels) + begin * 4,
+                   (end - begin) * 4);
+        });
+        return;
+    }
+
+    if (image.depth == StbImage::DEPTH_16) {
+        const uint16_t *src = static_cast<const uint16_t*>(image.pixels);
+        std::vector<float> linear(65536);
+        for (uint32_t i = 0; i < linear.size(); i++) {
+            float encoded = i / 65535.0f;
+            linear[i] = encoded <= 0.04045f ? encoded / 12.92f : std::pow((encoded + 0.055f) / 1.055f, 2.4f);
+        }
+        if (format == VK_FORMAT_R16G16B16A16_SFLOAT) {
+            std::vector<uint16_t> colorHalf(65536), alphaHalf(65536);
+            for (uint32_t i = 0; i < colorHalf.size(); i++) {
+                colorHalf[i] = glm::packHalf1x16(linear[i]);
+                alphaHalf[i] = glm::packHalf1x16(i / 65535.0f);
+            }
+            uint16_t *texels = static_cast<uint16_t*>(dst);
+            forTexels(jobs, count, [&](size_t begin, size_t end) {
+                for (size_t i = begin * 4; i < end * 4; i += 4) {
+                    texels[i] = colorHalf[src[i]];
+                    texels[i + 1] = colorHalf[src[i + 1]];
+                    texels[i + 2] = colorHalf[src[i + 2]];
+                    texels[i + 3] = alphaHalf[src[i + 3]];
+                }
+            });
+        } else {
+            float *texels = static_cast<float*>(dst);
+            forTexels(jobs, count, [&](size_t begin, size_t end) {
+                for (size_t i = begin * 4; i < end * 4; i += 4) {
+                    texels[i] = linear[src[i]];
+                    texels[i + 1] = linear[src[i + 1]];
+                    texels[i + 2] = linear[src[i + 2]];
+                    texels[i + 3] = src[i + 3] / 65535.0f;
+                }
+            });
+        }
+        return;
+    }
+
+    const glm::vec3 *src = static_cast<const glm::vec3*>(image.pixels);
+    forTexels(jobs, count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            glm::vec3 color = glm::max(src[i], glm::vec3(0.0f));
+            switch (format) {
+                case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+                    static_cast<uint32_t*>(dst)[i] = glm::packF3x9_E1x5(color);
+                    break;
+                case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+                    static_cast<uint32_t*>(dst)[i] = glm::packF2x11_1x10(color);
+                    break;
+                case VK_FORMAT_R16G16B16A16_SFLOAT:
+                    static_cast<uint64_t*>(dst)[i] = glm::packHalf4x16(glm::vec4(color, 1.0f));
+                    break;
+                default:
+                    static_cast<glm::vec4*>(dst)[i] = glm::vec4(color, 1.0f);
+                    break;
+            }
+        }
+    });
 }
 
 void Model::createTextureObjects() {
+    this->textureFormat = chooseTextureFormat();
+    this->stb_image.size = static_cast<VkDeviceSize>(this->stb_image.texWidth) * this->stb_image.texHeight *
+        texelSize(this->textureFormat);
+    if (debug) {
+        std::cout << "texture: " << this->stb_image.texWidth << "x" << this->stb_image.texHeight
+                  << ", format " << this->textureFormat << ", " << (this->stb_image.size >> 20) << " MiB" << std::endl;
+    }
 
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -33,12 +173,12 @@ void Model::createTextureObjects() {
     imageInfo.extent.depth = 1;
     imageInfo.mipLevels = 1;
     imageInfo.arrayLayers = 1;
-    imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+    imageInfo.format = this->textureFormat;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    this->device->setConcurrentSharing(imageInfo);  // the Adjuster reads it on the compute queue
     imageInfo.flags = 0;
 
     this->device->createImage(
@@ -48,6 +188,20 @@ void Model::createTextureObjects() {
         this->textureMemory
     );
 
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = this->textureImage;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = imageInfo.format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+    if (VK_SUCCESS != vkCreateImageView(this->device->device, &viewInfo, nullptr, &this->textureView)) {
+        throw std::runtime_error("failed to create texture image view!");
+    }
+
     this->device->createBuffer(
         this->stb_image.size,
         VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -64,6 +218,7 @@ void Model::createTextureObjects() {
         0, //VkMemoryMapFlags flags,
         &(this->textureStagingData) // void **ppData
     );
+    this->textureStagingSize = this->stb_image.size;
 
 
     //VkImageCreateInfo stagingImageInfo{};
@@ -97,9 +252,13 @@ void Model::createTextureObjects() {
 }
 
 void Model::destroyTextureObjects() {
+    while (!this->hostImports.empty()) {
+        releaseHostPixels(this->hostImports.begin()->first);
+    }
     vkUnmapMemory(this->device->device, this->textureStagingMemory);
 
     vkDestroyBuffer(this->device->device, this->textureStagingBuffer, nullptr);
+    vkDestroyImageView(this->device->device, this->textureView, nullptr);
     vkDestroyImage(this->device->device, this->textureImage, nullptr);
 
     vkFreeMemory(this->device->device, this->textureStagingMemory, nullptr);
@@ -112,10 +271,59 @@ void Model::destroyTextureObjects() {
 //    endSingleTimeCommands(commandBuffer);
 //}
 
+// records the copy of a tightly packed staging buffer into mip 0 of the image,
+// the image is left ready for finalAccess
+void Model::recordTextureUpload(
+    VkCommandBuffer commandBuffer,
+    VkBuffer stagingBuffer,
+    VkImage image,
+    uint32_t width,
+    uint32_t height,
+    RenderGraph::Access finalAccess
+) {
+    RenderGraph uploadGraph{};
+    RenderGraph::ResourceId staging = uploadGraph.importBuffer("staging", stagingBuffer);
+    RenderGraph::ResourceId texture = uploadGraph.importImage(
+        "texture", image, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED, finalAccess
+    );
+
+    uploadGraph.addPass(
+        "upload",
+        {{staging, RenderGraph::ACCESS_TRANSFER_READ}},
+        {{texture, RenderGraph::ACCESS_TRANSFER_WRITE}},
+        [&](VkCommandBuffer commandBuffer, RenderGraph &graph) {
+            VkBufferImageCopy copyRegion{};
+            copyRegion.bufferOffset = 0;
+            copyRegion.bufferRowLength = 0;
+            copyRegion.bufferImageHeight = 0;
+
+            copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            copyRegion.imageSubresource.mipLevel = 0;
+            copyRegion.imageSubresource.baseArrayLayer = 0;
+            copyRegion.imageSubresource.layerCount = 1;
+
+            copyRegion.imageOffset = {0, 0, 0};
+            copyRegion.imageExtent.width = width;
+            copyRegion.imageExtent.height = height;
+            copyRegion.imageExtent.depth = 1;
+
+            vkCmdCopyBufferToImage(
+                commandBuffer,
+                graph.getBuffer(staging),
+                graph.getImage(texture),
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1,
+                &copyRegion
+            );
+        }
+    );
+    uploadGraph.execute(commandBuffer);
+}
+
 void Model::writeTextureToGPU() {
 
     //this->commandBuffers.resize(this->swapchain->imageCount);
-    memcpy(this->textureStagingData, this->stb_image.pixels, this->textureStagingSize);
+    writeTexels(this->stb_image, this->textureFormat, this->textureStagingData, this->jobs);
 
     // create cmd buffer
     VkCommandBuffer commandBuffer;
@@ -139,81 +347,15 @@ void Model::writeTextureToGPU() {
         throw std::runtime_error("failed to begin recording command buffer!");
     }
 
-    // image layout: UNDEFINED -> TRANSFER_DST_OPTIMAL
-    VkImageMemoryBarrier barrier1{};
-    barrier1.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier1.srcAccessMask = 0;
-    barrier1.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier1.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    barrier1.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier1.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier1.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier1.image = this->textureImage;
-    barrier1.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier1.subresourceRange.baseMipLevel = 0;
-    barrier1.subresourceRange.levelCount = 1;
-    barrier1.subresourceRange.baseArrayLayer = 0;
-    barrier1.subresourceRange.layerCount = 1;
-
-    vkCmdPipelineBarrier(
-        commandBuffer,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &barrier1
-    );
-
-    VkBufferImageCopy copyRegion{};
-    copyRegion.bufferOffset = 0;
-    copyRegion.bufferRowLength = 0;
-    copyRegion.bufferImageHeight = 0;
-
-    copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    copyRegion.imageSubresource.mipLevel = 0;
-    copyRegion.imageSubresource.baseArrayLayer = 0;
-    copyRegion.imageSubresource.layerCount = 1;
-
-    copyRegion.imageOffset = {0, 0, 0};
-    copyRegion.imageExtent.width = this->stb_image.texWidth;
-    copyRegion.imageExtent.height = this->stb_image.texHeight;
-    copyRegion.imageExtent.depth = 1;
-    
-    vkCmdCopyBufferToImage(
+    Model::recordTextureUpload(
         commandBuffer,
         this->textureStagingBuffer,
         this->textureImage,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        1,
-        &copyRegion
+        this->stb_image.texWidth,
+        this->stb_image.texHeight,
+        RenderGraph::ACCESS_FRAGMENT_SAMPLED_READ
     );
 
-    // image layout:  TRANSFER_DST_OPTIMAL -> SHADER_READ_ONLY_OPTIMAL
-    VkImageMemoryBarrier barrier2{};
-    barrier2.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier2.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier2.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    barrier2.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier2.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier2.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier2.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier2.image = this->textureImage;
-    barrier2.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier2.subresourceRange.baseMipLevel = 0;
-    barrier2.subresourceRange.levelCount = 1;
-    barrier2.subresourceRange.baseArrayLayer = 0;
-    barrier2.subresourceRange.layerCount = 1;
-
-    vkCmdPipelineBarrier(
-        commandBuffer,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &barrier2
-    );
     //vkCmdCopyImage(
     //    commandBuffer,
     //    this->textureStagingImage, VkImageLayout srcImageLayout,
@@ -247,21 +389,128 @@ void Model::writeTextureToGPU() {
         throw std::runtime_error("failed to record command buffer!");
     }
 
+    // submitted with the first frame (or the first compute job, Device::flushDeferredGraphics);
+    // the staging buffer lives as long as the texture, nothing here has to wait for the copy
+    this->device->deferGraphicsCommands(commandBuffer);
+}
+
+
+// ########
+//  INGEST
+// ########
+
+// Frames from another process arrive in shared memory. Copying them into stb-style buffers and
+// then into textureStagingData would touch every pixel twice on the CPU; importing that memory
+// (VK_EXT_external_memory_host) makes it the staging buffer itself.
+
+uint64_t Model::ingestHostPixels(void *pixels, VkDeviceSize size) {
+    VkDeviceSize textureSize = static_cast<VkDeviceSize>(this->stb_image.texWidth) * this->stb_image.texHeight *
+        texelSize(this->textureFormat);
+    if (size < textureSize) {
+        throw std::runtime_error("failed to ingest host pixels, the buffer is smaller than the texture!");
+    }
+    auto found = this->hostImports.find(pixels);
+    if (found != this->hostImports.end() && found->second.size < size) {
+        // the same address, but a bigger mapping now; waits for the last copy from the old import
+        releaseHostPixels(pixels);
+        found = this->hostImports.end();
+    }
+    if (found == this->hostImports.end()) {
+        HostImport hostImport{};
+        hostImport.size = size;
+        this->device->importHostBuffer(pixels, size, hostImport.buffer, hostImport.memory);
+        found = this->hostImports.emplace(pixels, hostImport).first;
+    }
+
+    VkCommandBuffer commandBuffer;
+    VkCommandBufferAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandPool = this->device->commandPool;
+    allocateInfo.commandBufferCount = 1;
+    if (VK_SUCCESS != vkAllocateCommandBuffers(this->device->device, &allocateInfo, &commandBuffer)) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &beginInfo)) {
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+    // frames submitted earlier may still sample the texture; the upload graph's transition of it
+    // waits for all earlier commands (the history of an imported image is unknown to it)
+    Model::recordTextureUpload(
+        commandBuffer,
+        found->second.buffer,
+        this->textureImage,
+        this->stb_image.texWidth,
+        this->stb_image.texHeight,
+        RenderGraph::ACCESS_FRAGMENT_SAMPLED_READ
+    );
+    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
 
-    if (VK_SUCCESS != vkQueueSubmit(this->device->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE)) {
-        throw std::runtime_error("failed to submit copy command buffer!");
+    // the compute queue may still be reading the texture, this submission waits for it
+    if (this->beforeIngest) {
+        this->beforeIngest();
     }
-    vkQueueWaitIdle(this->device->graphicsQueue);
+    // submitted right away, the producer wants its memory back soon
+    this->device->deferGraphicsCommands(commandBuffer);
+    uint64_t value = this->device->flushDeferredGraphics();
+    found->second.lastUse = value;
+    return value;
+}
 
-    vkFreeCommandBuffers(this->device->device, this->device->commandPool, 1, &commandBuffer);
+void Model::releaseHostPixels(void *pixels) {
+    auto found = this->hostImports.find(pixels);
+    if (found == this->hostImports.end()) return;
+    this->device->waitGraphics(found->second.lastUse);
+    vkDestroyBuffer(this->device->device, found->second.buffer, nullptr);
+    vkFreeMemory(this->device->device, found->second.memory, nullptr);
+    this->hostImports.erase(found);
 }
 
 
+VkExtent2D Model::displayExtent(VkExtent2D viewExtent, float zoom) {
+    glm::vec2 positionMin(std::numeric_limits<float>::max()), positionMax(-std::numeric_limits<float>::max());
+    glm::vec2 texCoordMin(std::numeric_limits<float>::max()), texCoordMax(-std::numeric_limits<float>::max());
+    for (const Vertex &vertex : this->vertices) {
+        positionMin = glm::min(positionMin, vertex.position);
+        positionMax = glm::max(positionMax, vertex.position);
+        texCoordMin = glm::min(texCoordMin, vertex.texCoord);
+        texCoordMax = glm::max(texCoordMax, vertex.texCoord);
+    }
+    // NDC spans 2 per axis of the view; pixels covered per unit of texCoord
+    glm::vec2 pixels = (positionMax - positionMin) * 0.5f * zoom * glm::vec2(viewExtent.width, viewExtent.height);
+    glm::vec2 perTexCoord = pixels / glm::max(texCoordMax - texCoordMin, glm::vec2(1e-6f));
+    return {
+        std::max<uint32_t>(1, static_cast<uint32_t>(std::ceil(perTexCoord.x))),
+        std::max<uint32_t>(1, static_cast<uint32_t>(std::ceil(perTexCoord.y)))
+    };
+}
+
+VkRect2D Model::screenRect(VkExtent2D viewExtent, float zoom, glm::vec2 pan) {
+    glm::vec2 ndcMin(std::numeric_limits<float>::max()), ndcMax(-std::numeric_limits<float>::max());
+    for (const Vertex &vertex : this->vertices) {
+        glm::vec2 ndc = vertex.position * zoom + pan;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
+    }
+    glm::vec2 extent(viewExtent.width, viewExtent.height);
+    // a pixel of margin for the edge pixels rasterization and filtering touch
+    glm::vec2 pixelMin = glm::clamp(glm::floor((ndcMin + 1.0f) * 0.5f * extent) - 1.0f, glm::vec2(0.0f), extent);
+    glm::vec2 pixelMax = glm::clamp(glm::ceil((ndcMax + 1.0f) * 0.5f * extent) + 1.0f, glm::vec2(0.0f), extent);
+    if (pixelMax.x <= pixelMin.x || pixelMax.y <= pixelMin.y) {
+        return {};
+    }
+    return {
+        {static_cast<int32_t>(pixelMin.x), static_cast<int32_t>(pixelMin.y)},
+        {static_cast<uint32_t>(pixelMax.x - pixelMin.x), static_cast<uint32_t>(pixelMax.y - pixelMin.y)}
+    };
+}
+
 void Model::destroyVertexBuffers() {
     vkDestroyBuffer(this->device->device, vertexBuffer, nullptr);
     vkFreeMemory(this->device->device, vertexBufferMemory, nullptr);
@@ -15,8 +15,8 @@ void Pipeline::createPipelineLayout() {
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 0;
-    pipelineLayoutInfo.pSetLayouts = nullptr;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(this->setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = this->setLayouts.data();
     pipelineLayoutInfo.pushConstantRangeCount = 1;
     pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
     if (VK_SUCCESS != vkCreatePipelineLayout(this->device->device, &pipelineLayoutInfo, nullptr, &(this->pipelineLayout))) { 
@@ -97,14 +97,231 @@ void Pipeline::writeDefaultPipelineConf(VkExtent2D extent) {
     plconf->DepthStencilCI.stencilTestEnable = VK_FALSE;
     plconf->DepthStencilCI.front = {};  // Optional
     plconf->DepthStencilCI.back = {};   // Optional
+
+    plconf->vertexBindings = Model::getVertexBindingDescriptions();
+    plconf->vertexAttributes = Model::getVertexAttributeDescriptions();
 }
   VkDeviceSize offsets[] = {0};
 
-void Pipeline::destroyPipeline() {
-    vkDestroyPipeline(this->device->device, this->pipeline, nullptr);
+// Every variant of the fixed function state is looked up by the bytes of the state that goes into
+// vkCreateGraphicsPipelines (pointers left out, what they point to put in), plus the shader
+// modules, the layout and what makes render passes compatible. The first request compiles it,
+// later ones get the same VkPipeline. variantAsync hands the compile to the job system instead and
+// returns a fallback (the pipeline drawn so far) until it is done, so a new variant never stalls
+// the frame loop while the driver compiles.
+
+template <typename T>
+static void appendKey(std::string &key, const T &value) {
+    key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void Pipeline::addRenderPass(VkRenderPass renderPass, const std::vector<VkAttachmentDescription> &attachments) {
+    std::string key;
+    for (const VkAttachmentDescription &attachment : attachments) {
+        appendKey(key, attachment.format);
+        appendKey(key, attachment.samples);
+    }
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->renderPasses[renderPass] = key;
+}
+
+std::string Pipeline::variantKey(const PipelineConf &conf, VkRenderPass renderPass) {
+    std::string key;
+    appendKey(key, this->vertShaderModule);
+    appendKey(key, this->fragShaderModule);
+    appendKey(key, this->pipelineLayout);
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto found = this->renderPasses.find(renderPass);
+        if (found == this->renderPasses.end()) {
+            throw std::runtime_error("failed to find render pass of pipeline variant!");
+        }
+        key.append(found->second);
+    }
+
+    appendKey(key, conf.InputAssemblyCI.topology);
+    appendKey(key, conf.InputAssemblyCI.primitiveRestartEnable);
+    // the scissor is dynamic state
+    appendKey(key, conf.viewport);
+
+    const VkPipelineRasterizationStateCreateInfo &raster = conf.RasterizationCI;
+    appendKey(key, raster.depthClampEnable);
+    appendKey(key, raster.rasterizerDiscardEnable);
+    appendKey(key, raster.polygonMode);
+    appendKey(key, raster.cullMode);
+    appendKey(key, raster.frontFace);
+    appendKey(key, raster.depthBiasEnable);
+    appendKey(key, raster.depthBiasConstantFactor);
+    appendKey(key, raster.depthBiasClamp);
+    appendKey(key, raster.depthBiasSlopeFactor);
+    appendKey(key, raster.lineWidth);
+
+    const VkPipelineMultisampleStateCreateInfo &multisample = conf.MultisampleCI;
+    appendKey(key, multisample.rasterizationSamples);
+    appendKey(key, multisample.sampleShadingEnable);
+    appendKey(key, multisample.minSampleShading);
+    appendKey(key, multisample.alphaToCoverageEnable);
+    appendKey(key, multisample.alphaToOneEnable);
+
+    const VkPipelineDepthStencilStateCreateInfo &depth = conf.DepthStencilCI;
+    appendKey(key, depth.depthTestEnable);
+    appendKey(key, depth.depthWriteEnable);
+    appendKey(key, depth.depthCompareOp);
+    appendKey(key, depth.depthBoundsTestEnable);
+    appendKey(key, depth.stencilTestEnable);
+    appendKey(key, depth.front);
+    appendKey(key, depth.back);
+    appendKey(key, depth.minDepthBounds);
+    appendKey(key, depth.maxDepthBounds);
+
+    appendKey(key, conf.colorBlendAttachment);
+    appendKey(key, conf.ColorBlendCI.logicOpEnable);
+    appendKey(key, conf.ColorBlendCI.logicOp);
+    appendKey(key, conf.ColorBlendCI.blendConstants);
+
+    // all of their members are 32 bit, no padding gets in
+    for (const VkVertexInputBindingDescription &binding : conf.vertexBindings) appendKey(key, binding);
+    for (const VkVertexInputAttributeDescription &attribute : conf.vertexAttributes) appendKey(key, attribute);
+    return key;
+}
+
+VkPipeline Pipeline::variant(const PipelineConf &conf, VkRenderPass renderPass) {
+    std::string key = this->variantKey(conf, renderPass);
+    std::unique_lock<std::mutex> lock(this->mutex);
+    // one being compiled in the background is waited for rather than compiled twice
+    this->variantCompiled.wait(lock, [this, &key] {
+        auto found = this->registry.find(key);
+        return found == this->registry.end() || found->second != VK_NULL_HANDLE;
+    });
+    auto found = this->registry.find(key);
+    if (found != this->registry.end()) {
+        this->variantsReused++;
+        return found->second;
+    }
+    this->registry.emplace(key, VK_NULL_HANDLE);
+    lock.unlock();
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    try {
+        pipeline = this->buildPipeline(conf, renderPass);
+    } catch (...) {
+        lock.lock();
+        this->registry.erase(key);
+        lock.unlock();
+        this->variantCompiled.notify_all();
+        throw;
+    }
+    lock.lock();
+    this->registry[key] = pipeline;
+    this->failed.erase(key);
+    lock.unlock();
+    this->variantCompiled.notify_all();
+    this->variantsCreated++;
+    return pipeline;
+}
+
+VkPipeline Pipeline::variantAsync(const PipelineConf &conf, VkRenderPass renderPass, VkPipeline fallback) {
+    std::string key = this->variantKey(conf, renderPass);
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto found = this->registry.find(key);
+        if (found != this->registry.end()) {
+            if (found->second == VK_NULL_HANDLE) return fallback;
+            this->variantsReused++;
+            return found->second;
+        }
+        if (this->failed.count(key) > 0) return fallback;
+        if (nullptr != this->jobs) {
+            this->registry.emplace(key, VK_NULL_HANDLE);
+        }
+    }
+    if (nullptr == this->jobs) {
+        // nobody to hand it to
+        return this->variant(conf, renderPass);
+    }
+    CompileJob job{key, conf, renderPass};
+    JobSystem::Handle compile = this->jobs->submit([this, job]() { this->compile(job); });
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->compiles.erase(std::remove_if(this->compiles.begin(), this->compiles.end(),
+        [this](const JobSystem::Handle &running) { return this->jobs->isDone(running); }), this->compiles.end());
+    this->compiles.push_back(compile);
+    return fallback;
+}
+
+void Pipeline::createCompiler(JobSystem *jobs) {
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if (VK_SUCCESS != vkCreatePipelineCache(this->device->device, &cacheInfo, nullptr, &this->pipelineCache)) {
+        throw std::runtime_error("failed to create pipeline cache!");
+    }
+    this->stopping = false;
+    this->jobs = jobs;
+}
+
+void Pipeline::destroyCompiler() {
+    std::vector<JobSystem::Handle> compiles = {};
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+        compiles.swap(this->compiles);
+    }
+    for (const JobSystem::Handle &compile : compiles) {
+        this->jobs->wait(compile);
+    }
+    this->jobs = nullptr;
+    this->variantCompiled.notify_all();
+    vkDestroyPipelineCache(this->device->device, this->pipelineCache, nullptr);
+    this->pipelineCache = VK_NULL_HANDLE;
 }
+
+void Pipeline::compile(const CompileJob &job) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (this->stopping) {
+        // never started, nobody is going to use it
+        this->registry.erase(job.key);
+        lock.unlock();
+        this->variantCompiled.notify_all();
+        return;
+    }
+    lock.unlock();
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    try {
+        pipeline = this->buildPipeline(job.conf, job.renderPass);
+    } catch (const std::exception &e) {
+        std::cerr << "pipeline: background compile failed: " << e.what() << std::endl;
+    }
+
+    lock.lock();
+    if (pipeline != VK_NULL_HANDLE) {
+        this->registry[job.key] = pipeline;
+        this->variantsCreated++;
+        this->variantsInBackground++;
+    } else {
+        this->registry.erase(job.key);
+        this->failed.insert(job.key);
+    }
+    lock.unlock();
+    this->variantCompiled.notify_all();
+    if (pipeline != VK_NULL_HANDLE && this->notify) {
+        this->notify();
+    }
+}
+
 void Pipeline::createPipeline(VkRenderPass renderPass) {
+    this->pipeline = this->variant(this->pipelineConfig, renderPass);
+}
 
+void Pipeline::destroyPipeline() {
+    for (auto &entry : this->registry) {
+        vkDestroyPipeline(this->device->device, entry.second, nullptr);
+    }
+    this->registry.clear();
+    this->failed.clear();
+    this->pipeline = VK_NULL_HANDLE;
+}
+
+VkPipeline Pipeline::buildPipeline(const PipelineConf &conf, VkRenderPass renderPass) {
     std::array<VkPipelineShaderStageCreateInfo,2> shaderStages = {};
 
     shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -122,17 +339,21 @@ void Pipeline::createPipeline(VkRenderPass renderPass) {
     shaderStages[1].pNext = nullptr;
     shaderStages[1].pSpecializationInfo = nullptr;
 
-    auto vertexBindingDescriptions = Model::getVertexBindingDescriptions();
-    auto vertexAttributeDescriptions = Model::getVertexAttributeDescriptions();
+    const PipelineConf *plconf = &conf;
+    // conf may be a copy whose pointers still point into the original
+    VkPipelineViewportStateCreateInfo viewportInfo = plconf->ViewportCI;
+    viewportInfo.pViewports = &(plconf->viewport);
+    viewportInfo.pScissors = &(plconf->scissor);
+    VkPipelineColorBlendStateCreateInfo colorBlendInfo = plconf->ColorBlendCI;
+    colorBlendInfo.pAttachments = &(plconf->colorBlendAttachment);
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexBindingDescriptions.size());
-    vertexInputInfo.pVertexBindingDescriptions    = vertexBindingDescriptions.data();
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexAttributeDescriptions.size());
-    vertexInputInfo.pVertexAttributeDescriptions    = vertexAttributeDescriptions.data();
+    vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(plconf->vertexBindings.size());
+    vertexInputInfo.pVertexBindingDescriptions    = plconf->vertexBindings.data();
+    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(plconf->vertexAttributes.size());
+    vertexInputInfo.pVertexAttributeDescriptions    = plconf->vertexAttributes.data();
 
-    PipelineConf *plconf = &(this->pipelineConfig);
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     //pipelineInfo.pNext = nullptr;
@@ -141,12 +362,18 @@ void Pipeline::createPipeline(VkRenderPass renderPass) {
     pipelineInfo.pStages = shaderStages.data();
     pipelineInfo.pVertexInputState = &vertexInputInfo;
     pipelineInfo.pInputAssemblyState = &(plconf->InputAssemblyCI);
-    pipelineInfo.pViewportState      = &(plconf->ViewportCI);
+    pipelineInfo.pViewportState      = &viewportInfo;
     pipelineInfo.pRasterizationState = &(plconf->RasterizationCI);
     pipelineInfo.pMultisampleState   = &(plconf->MultisampleCI);
     pipelineInfo.pDepthStencilState  = &(plconf->DepthStencilCI);
-    pipelineInfo.pColorBlendState    = &(plconf->ColorBlendCI);
-    //pipelineInfo.pDynamicState = nullptr;
+    pipelineInfo.pColorBlendState    = &colorBlendInfo;
+    // the renderer narrows the scissor to what is redrawn
+    VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicStateInfo{};
+    dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateInfo.dynamicStateCount = 1;
+    dynamicStateInfo.pDynamicStates = dynamicStates;
+    pipelineInfo.pDynamicState = &dynamicStateInfo;
 
     pipelineInfo.layout = this->pipelineLayout;
     pipelineInfo.renderPass = renderPass;
@@ -155,15 +382,17 @@ void Pipeline::createPipeline(VkRenderPass renderPass) {
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineInfo.basePipelineIndex = -1;
     //
+    VkPipeline pipeline = VK_NULL_HANDLE;
     if (VK_SUCCESS != vkCreateGraphicsPipelines(
           this->device->device,
-          VK_NULL_HANDLE,
+          this->pipelineCache,    // internally synchronized, shared by the compile jobs
           1,
           &pipelineInfo,
           nullptr,
-          &(this->pipeline)
+          &pipeline
     )) {
     throw std::runtime_error("failed to create graphics pipeline!");
   }
+  return pipeline;
 }
 
@@ -0,0 +1,144 @@
+#include "types.hpp"
+#include <cstdint>
+#include <vulkan/vulkan_core.h>
+
+// vkQueuePresentKHR may block, in FIFO mode until a vblank frees an image on some drivers, and
+// while it does the main thread can neither handle input nor poll the background work for the
+// next frame. With a present thread the main thread only hands the frame over and goes on; it
+// waits for the present to have happened right before it acquires the next image, since acquire
+// and present must not touch the swapchain at the same time.
+
+void Presenter::create() {
+    this->stopping = false;
+    this->head = 0;
+    this->tail = 0;
+    this->presented = 0;
+    this->result = VK_SUCCESS;
+    if (this->threaded) {
+        this->worker = std::thread(&Presenter::work, this);
+    }
+}
+
+void Presenter::destroy() {
+    if (!this->worker.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->frameQueued.notify_one();
+    this->worker.join();
+}
+
+// ######
+//  RING
+// ######
+
+bool Presenter::push(const Request &request) {
+    uint32_t tail = this->tail.load(std::memory_order_relaxed);
+    if (tail - this->head.load(std::memory_order_acquire) == RING_SIZE) {
+        return false;
+    }
+    this->ring[tail % RING_SIZE] = request;
+    this->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool Presenter::pop(Request &request) {
+    uint32_t head = this->head.load(std::memory_order_relaxed);
+    if (head == this->tail.load(std::memory_order_acquire)) {
+        return false;
+    }
+    request = this->ring[head % RING_SIZE];
+    this->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+// #########
+//  PRESENT
+// #########
+
+VkResult Presenter::present(const Request &request) {
+    VkPresentRegionKHR presentRegion = {1, &request.rect};
+    VkPresentRegionsKHR presentRegions{};
+    presentRegions.sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR;
+    presentRegions.swapchainCount = 1;
+    presentRegions.pRegions = &presentRegion;
+
+    VkPresentInfoKHR presentInfo = {};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.pNext = request.incremental ? &presentRegions : nullptr;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &request.wait;
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &request.swapchain;
+    presentInfo.pImageIndices = &request.imageId;
+
+    // a present that blocks holds up submits to the queue it is on, if that is the graphics or
+    // compute queue as well, but not the recording for them, nor submits to the other queues
+    std::lock_guard<std::mutex> queueLock(this->device->queueMutex(this->device->presentQueue));
+    auto start = std::chrono::steady_clock::now();
+    VkResult result = vkQueuePresentKHR(this->device->presentQueue, &presentInfo);
+    auto end = std::chrono::steady_clock::now();
+    this->presentMs += std::chrono::duration<double, std::milli>(end - start).count();
+    this->presentCount++;
+    return result;
+}
+
+VkResult Presenter::submit(const Request &request) {
+    if (!this->worker.joinable()) {
+        return present(request);
+    }
+    if (!push(request)) {
+        // wait() before every acquire keeps the ring short, this is not expected
+        wait();
+        push(request);
+    }
+    // taking the lock orders the push before the present thread's check for an empty ring
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+    }
+    this->frameQueued.notify_one();
+    return VK_SUCCESS;
+}
+
+VkResult Presenter::wait() {
+    if (this->worker.joinable()) {
+        auto start = std::chrono::steady_clock::now();
+        uint32_t submitted = this->tail.load(std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->framePresented.wait(lock, [this, submitted] { return this->presented.load() == submitted; });
+        lock.unlock();
+        auto end = std::chrono::steady_clock::now();
+        this->waitMs += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+    return static_cast<VkResult>(this->result.exchange(VK_SUCCESS));
+}
+
+void Presenter::work() {
+    while (true) {
+        Request request;
+        if (pop(request)) {
+            VkResult result = present(request);
+            if (result != VK_SUCCESS) {
+                // suboptimal is only kept if nothing worse happened
+                int32_t expected = VK_SUCCESS;
+                if (!this->result.compare_exchange_strong(expected, result) && result != VK_SUBOPTIMAL_KHR) {
+                    this->result = result;
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->presented++;
+            }
+            this->framePresented.notify_all();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->frameQueued.wait(lock, [this] {
+            return this->stopping || this->head.load() != this->tail.load();
+        });
+        if (this->stopping && this->head.load() == this->tail.load()) {
+            return; // stopping and drained
+        }
+    }
+}
@@ -0,0 +1,247 @@
+#include "types.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <vulkan/vulkan_core.h>
+
+// The copy of the rendered image goes into one of ringSize host-visible buffers, in its own
+// submission between the frame's draw and its present. Nothing waits on it: poll() picks up the
+// slots whose fence has signaled (usually a couple of frames later) and hands the pixels over to
+// the encoder threads, which read the mapped slot itself; the slot is reused once its encode is
+// done, so capturing costs the frame loop neither a copy of the frame nor a GPU stall.
+
+void Readback::create() {
+    if (0 == (this->swapchain->swapChainImageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+        std::cerr << "readback: swapchain images can't be copied from, capturing is disabled" << std::endl;
+        this->supported = false;
+        return;
+    }
+    VkDeviceSize size =
+        static_cast<VkDeviceSize>(this->swapchain->swapChainExtent.width) * this->swapchain->swapChainExtent.height * 4;
+
+    this->slots.resize(this->ringSize);
+    std::vector<VkCommandBuffer> commandBuffers(this->ringSize);
+    VkCommandBufferAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandPool = this->device->commandPool;
+    allocateInfo.commandBufferCount = this->ringSize;
+    if (VK_SUCCESS != vkAllocateCommandBuffers(this->device->device, &allocateInfo, commandBuffers.data())) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+
+    // cached memory makes the encoder's reads fast, not every device has it coherent
+    VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (this->device->hasMemoryType(
+            this->device->bufferMemoryTypes(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+            properties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
+        properties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    }
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    for (uint32_t i = 0; i < this->ringSize; i++) {
+        Slot &slot = this->slots[i];
+        slot.commandBuffer = commandBuffers[i];
+        if (VK_SUCCESS != vkCreateFence(this->device->device, &fenceInfo, nullptr, &slot.fence)) {
+            throw std::runtime_error("failed to create readback fence!");
+        }
+        this->device->createBuffer(
+            size,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            properties,
+            slot.buffer,
+            slot.memory
+        );
+        vkMapMemory(this->device->device, slot.memory, 0, size, 0, &slot.data);
+    }
+    std::filesystem::create_directories(this->outputDir);
+}
+
+void Readback::destroy() {
+    if (nullptr != this->encoder) {
+        this->encoder->flush();
+    }
+    for (Slot &slot : this->slots) {
+        vkUnmapMemory(this->device->device, slot.memory);
+        vkDestroyBuffer(this->device->device, slot.buffer, nullptr);
+        vkFreeMemory(this->device->device, slot.memory, nullptr);
+        vkDestroyFence(this->device->device, slot.fence, nullptr);
+        vkFreeCommandBuffers(this->device->device, this->device->commandPool, 1, &slot.commandBuffer);
+    }
+    this->slots.clear();
+    this->next = 0;
+}
+
+// returns the slot the current frame is copied into, -1 if this frame isn't captured
+int32_t Readback::beginCapture() {
+    this->frameNumber++;
+    if (!this->supported || !(this->captureAll || this->captureNext)) {
+        return -1;
+    }
+    Slot &slot = this->slots[this->next];
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (slot.encoding) {
+            // still being encoded, rather lose the capture than stall
+            this->droppedCount++;
+            return -1;
+        }
+    }
+    if (slot.inUse) {
+        if (VK_SUCCESS != vkGetFenceStatus(this->device->device, slot.fence)) {
+            // the GPU is ringSize frames behind, rather lose the capture than stall
+            this->droppedCount++;
+            return -1;
+        }
+        collect(slot);
+    }
+    this->captureNext = false;
+    int32_t slotId = static_cast<int32_t>(this->next);
+    this->next = (this->next + 1) % this->ringSize;
+    return slotId;
+}
+
+void Readback::submitCopy(int32_t slotId, uint32_t imageId, VkSemaphore signalSemaphore) {
+    Slot &slot = this->slots[slotId];
+    VkCommandBuffer commandBuffer = slot.commandBuffer;
+    VkImage image = this->swapchain->swapChainImages[imageId];
+    VkExtent2D extent = this->swapchain->swapChainExtent;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &beginInfo)) {
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
+
+    // image layout: finalLayout -> TRANSFER_SRC_OPTIMAL
+    VkImageMemoryBarrier barrier1{};
+    barrier1.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier1.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier1.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier1.oldLayout = this->swapchain->finalLayout;
+    barrier1.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier1.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier1.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier1.image = image;
+    barrier1.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier1.subresourceRange.baseMipLevel = 0;
+    barrier1.subresourceRange.levelCount = 1;
+    barrier1.subresourceRange.baseArrayLayer = 0;
+    barrier1.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier1
+    );
+
+    VkBufferImageCopy copyRegion{};
+    copyRegion.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    copyRegion.imageExtent = {extent.width, extent.height, 1};
+    vkCmdCopyImageToBuffer(
+        commandBuffer,
+        image,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        slot.buffer,
+        1,
+        &copyRegion
+    );
+
+    // image layout: TRANSFER_SRC_OPTIMAL -> finalLayout, the present waits on the semaphore
+    VkImageMemoryBarrier barrier2 = barrier1;
+    barrier2.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier2.dstAccessMask = 0;
+    barrier2.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier2.newLayout = this->swapchain->finalLayout;
+
+    VkBufferMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.buffer = slot.buffer;
+    hostBarrier.offset = 0;
+    hostBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0,
+        0, nullptr,
+        1, &hostBarrier,
+        1, &barrier2
+    );
+
+    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = (VK_NULL_HANDLE == signalSemaphore) ? 0 : 1;
+    submitInfo.pSignalSemaphores = &signalSemaphore;
+
+    vkResetFences(this->device->device, 1, &slot.fence);
+    {
+        std::lock_guard<std::mutex> queueLock(this->device->queueMutex(this->device->graphicsQueue));
+        if (VK_SUCCESS != vkQueueSubmit(this->device->graphicsQueue, 1, &submitInfo, slot.fence)) {
+            throw std::runtime_error("failed to submit readback command buffer!");
+        }
+    }
+    slot.inUse = true;
+    slot.frame = this->frameNumber;
+}
+
+void Readback::collect(Slot &slot) {
+    slot.inUse = false;
+    if (this->encoder->pending() >= this->maxQueued) {
+        this->droppedCount++;
+        return;
+    }
+    VkExtent2D extent = this->swapchain->swapChainExtent;
+    char name[32];
+    std::snprintf(name, sizeof(name), "frame_%06llu", static_cast<unsigned long long>(slot.frame));
+
+    ImageEncoder::Job job{};
+    job.path = (std::filesystem::path(this->outputDir) / name).string() + ImageEncoder::extension(this->format);
+    job.format = this->format;
+    job.width = extent.width;
+    job.height = extent.height;
+    job.bgra = this->swapchain->swapChainImageFormat == VK_FORMAT_B8G8R8A8_SRGB ||
+               this->swapchain->swapChainImageFormat == VK_FORMAT_B8G8R8A8_UNORM;
+    job.data = static_cast<uint8_t*>(slot.data);
+    job.done = [this, &slot]() {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        slot.encoding = false;
+    };
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        slot.encoding = true;
+    }
+    this->encoder->push(std::move(job));
+    this->capturedCount++;
+}
+
+void Readback::poll() {
+    for (Slot &slot : this->slots) {
+        if (slot.inUse && VK_SUCCESS == vkGetFenceStatus(this->device->device, slot.fence)) {
+            collect(slot);
+        }
+    }
+}
+
+void Readback::flush() {
+    for (Slot &slot : this->slots) {
+        if (slot.inUse) {
+            vkWaitForFences(this->device->device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+            collect(slot);
+        }
+    }
+}
@@ -17,7 +17,6 @@ void Renderer::createSemaphoresFences() {
   this->imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
   this->renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
   this->inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-  this->imagesInFlight.resize(this->swapchain->imageCount, VK_NULL_HANDLE);
 
   VkSemaphoreCreateInfo semaphoreInfo = {};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -44,6 +43,11 @@ VkResult Renderer::acquireNextImage(uint32_t *imageId) {
         VK_TRUE,
         std::numeric_limits<uint64_t>::max()
     );
+    if (this->offscreen) {
+        *imageId = this->nextOffscreenImage;
+        this->nextOffscreenImage = (this->nextOffscreenImage + 1) % this->swapchain->imageCount;
+        return VK_SUCCESS;
+    }
     VkResult result = vkAcquireNextImageKHR(
         this->device->device,
         this->swapchain->swapchain,
@@ -55,109 +59,287 @@ VkResult Renderer::acquireNextImage(uint32_t *imageId) {
     return result;
 }
 
+// ######
+//  VIEW
+// ######
+
+void View::zoomAt(glm::vec2 cursor, float factor) {
+    float zoom = std::clamp(this->zoom * factor, this->minZoom, this->maxZoom);
+    // the content point under the cursor, before and after: cursor = point * zoom + pan
+    glm::vec2 point = (cursor - this->pan) / this->zoom;
+    this->pan = cursor - point * zoom;
+    this->zoom = zoom;
+}
+
+void View::panBy(glm::vec2 delta) {
+    this->pan += delta;
+}
+
+void View::reset() {
+    this->zoom = 1.0f;
+    this->pan = {0.0f, 0.0f};
+}
+
+void View::write(PushConstants &pushConstants) {
+    pushConstants.viewScale = {this->zoom, this->zoom};
+    pushConstants.viewOffset = this->pan;
+}
+
 // #################
 //  COMMAND BUFFERS
 // #################
 
+// A command buffer per swapchain image from the shared pool had to wait for that image's last
+// submission before it could be re-recorded, and freeing and re-recording buffers one by one in a
+// pool that allows it makes the driver track every buffer's memory. A frame in flight instead owns
+// a transient pool: once its fence has signaled, vkResetCommandPool recycles everything recorded
+// into it at once and keeps the memory for the next recording.
+
 void Renderer::createCommandBuffers() {
-    this->commandBuffers.resize(this->swapchain->imageCount);
+    this->framePools.resize(MAX_FRAMES_IN_FLIGHT);
+    this->commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
 
-    VkCommandBufferAllocateInfo allocateInfo{};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocateInfo.commandPool = this->device->commandPool;
-    allocateInfo.commandBufferCount = static_cast<uint32_t>(this->commandBuffers.size());
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = this->device->queueFamilies.graphicsFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 
-    if (VK_SUCCESS != vkAllocateCommandBuffers(this->device->device, &allocateInfo, this->commandBuffers.data())) {
-        throw std::runtime_error("failed to allocate command buffers!");
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (VK_SUCCESS != vkCreateCommandPool(this->device->device, &poolInfo, nullptr, &this->framePools[i])) {
+            throw std::runtime_error("failed to create command pool!");
+        }
+        VkCommandBufferAllocateInfo allocateInfo{};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandPool = this->framePools[i];
+        allocateInfo.commandBufferCount = 1;
+        if (VK_SUCCESS != vkAllocateCommandBuffers(this->device->device, &allocateInfo, &this->commandBuffers[i])) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
     }
+
+    resetDamage();
+    vkGetRenderAreaGranularity(this->device->device, this->swapchain->renderpassPartial, &this->renderAreaGranularity);
 }
 void Renderer::destroyCommandBuffers() {
-    vkFreeCommandBuffers(
-        this->device->device,
-        this->device->commandPool,
-        static_cast<uint32_t>(this->commandBuffers.size()),
-        this->commandBuffers.data());
+    // the command buffers go with their pools
+    for (VkCommandPool pool : this->framePools) {
+        vkDestroyCommandPool(this->device->device, pool, nullptr);
+    }
+    this->framePools.clear();
     this->commandBuffers.clear();
 }
+// after SwapChain::recreateSwapChain (device idle), the image count may have changed
+void Renderer::swapChainRecreated() {
+    resetDamage();
+    vkGetRenderAreaGranularity(this->device->device, this->swapchain->renderpassPartial, &this->renderAreaGranularity);
+    this->nextOffscreenImage = 0;
+}
 
-void Renderer::recordCommandBuffers(Model *model) {
-    for (size_t i = 0; i < this->commandBuffers.size(); i++) {
-        VkCommandBufferBeginInfo beginInfo = {};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = 0;                   // Optional
-        beginInfo.pInheritanceInfo = nullptr;  // Optional
+// new images hold nothing yet
+void Renderer::resetDamage() {
+    VkRect2D whole = {{0, 0}, this->swapchain->swapChainExtent};
+    this->imageDamage.assign(this->swapchain->imageCount, whole);
+    this->presentDamage = whole;
+}
 
-        if (VK_SUCCESS != vkBeginCommandBuffer(this->commandBuffers[i], &beginInfo)) {
-            throw std::runtime_error("failed to begin recording command buffer!");
-        }
-        VkRenderPassBeginInfo renderPassInfo = {};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = this->swapchain->renderpass;
-        renderPassInfo.framebuffer = this->swapchain->swapChainFrameBuffers[i];
-
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = this->swapchain->swapChainExtent;
-
-        std::array<VkClearValue, 2> clearValues{};
-        clearValues[0].color = {0.1f, 0.1f, 0.1f, 1.0f};
-        clearValues[1].depthStencil = {1.0f, 0};
-        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        renderPassInfo.pClearValues = clearValues.data();
-
-        vkCmdBeginRenderPass(this->commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        vkCmdBindPipeline(this->commandBuffers[i], this->pipelineBindType, this->pipeline);
-          
-        //vkCmdDraw(this->commandBuffers[i], 3, 1, 0, 0);
-        model->bind(commandBuffers[i]);
-        model->draw(commandBuffers[i]);
-
-        vkCmdEndRenderPass(this->commandBuffers[i]);
-        if (VK_SUCCESS != vkEndCommandBuffer(this->commandBuffers[i])) {
+void Renderer::setContents(Model *model) {
+    this->contents = [this, model](VkCommandBuffer commandBuffer, PushConstants &pushConstants) {
+        pushConstants.textureIndex = model->displayIndex;
+        vkCmdPushConstants(
+            commandBuffer,
+            this->pipelineLayout,
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            0,
+            sizeof(PushConstants),
+            &pushConstants
+        );
+        model->bind(commandBuffer);
+        model->draw(commandBuffer);
+    };
+}
+
+// the whole grid is one instanced draw, no matter how many thumbnails it has
+void Renderer::setContents(ContactSheet *sheet) {
+    this->contents = [this, sheet](VkCommandBuffer commandBuffer, PushConstants &pushConstants) {
+        sheet->bind(commandBuffer, this->pipelineLayout, pushConstants);
+        sheet->draw(commandBuffer);
+    };
+}
+
+// ########
+//  DAMAGE
+// ########
+
+// Swapchain images keep their contents between frames, so an image only needs what changed since
+// it was itself last drawn: every damaged rect is added to every image's bounding rect, drawing an
+// image empties its own. The presentation engine only needs what changed since the last present.
+
+static bool isEmpty(const VkRect2D &rect) {
+    return rect.extent.width == 0 || rect.extent.height == 0;
+}
+
+static VkRect2D uniteRects(const VkRect2D &a, const VkRect2D &b) {
+    if (isEmpty(a)) return b;
+    if (isEmpty(b)) return a;
+    int32_t x0 = std::min(a.offset.x, b.offset.x);
+    int32_t y0 = std::min(a.offset.y, b.offset.y);
+    int32_t x1 = std::max(a.offset.x + static_cast<int32_t>(a.extent.width), b.offset.x + static_cast<int32_t>(b.extent.width));
+    int32_t y1 = std::max(a.offset.y + static_cast<int32_t>(a.extent.height), b.offset.y + static_cast<int32_t>(b.extent.height));
+    return {{x0, y0}, {static_cast<uint32_t>(x1 - x0), static_cast<uint32_t>(y1 - y0)}};
+}
+
+// render areas off the granularity are allowed, but may cost the same as the aligned one anyway
+static VkRect2D alignRect(const VkRect2D &rect, VkExtent2D granularity, VkExtent2D extent) {
+    if (isEmpty(rect)) return {};
+    uint32_t gx = std::max(1u, granularity.width);
+    uint32_t gy = std::max(1u, granularity.height);
+    uint32_t x0 = static_cast<uint32_t>(rect.offset.x) / gx * gx;
+    uint32_t y0 = static_cast<uint32_t>(rect.offset.y) / gy * gy;
+    uint32_t x1 = std::min((rect.offset.x + rect.extent.width + gx - 1) / gx * gx, extent.width);
+    uint32_t y1 = std::min((rect.offset.y + rect.extent.height + gy - 1) / gy * gy, extent.height);
+    return {{static_cast<int32_t>(x0), static_cast<int32_t>(y0)}, {x1 - x0, y1 - y0}};
+}
+
+void Renderer::damage(VkRect2D rect) {
+    // nothing to track before createCommandBuffers, which starts with everything damaged
+    if (this->imageDamage.empty()) return;
+    int32_t width = static_cast<int32_t>(this->swapchain->swapChainExtent.width);
+    int32_t height = static_cast<int32_t>(this->swapchain->swapChainExtent.height);
+    int32_t x0 = std::clamp(rect.offset.x, 0, width);
+    int32_t y0 = std::clamp(rect.offset.y, 0, height);
+    int32_t x1 = std::clamp(rect.offset.x + static_cast<int32_t>(rect.extent.width), 0, width);
+    int32_t y1 = std::clamp(rect.offset.y + static_cast<int32_t>(rect.extent.height), 0, height);
+    if (x1 <= x0 || y1 <= y0) return;
+    rect = {{x0, y0}, {static_cast<uint32_t>(x1 - x0), static_cast<uint32_t>(y1 - y0)}};
+
+    for (VkRect2D &imageRect : this->imageDamage) {
+        imageRect = uniteRects(imageRect, rect);
+    }
+    this->presentDamage = uniteRects(this->presentDamage, rect);
+}
+
+void Renderer::damageAll() {
+    damage({{0, 0}, this->swapchain->swapChainExtent});
+}
+
+// a handful of commands, cheap enough to redo every frame; the view only lives in push constants,
+// so zooming and panning never touch vertex memory
+void Renderer::recordCommandBuffer(uint32_t imageId) {
+    // the frame's fence was waited for in acquireNextImage; no flags, the pool keeps its memory
+    if (VK_SUCCESS != vkResetCommandPool(this->device->device, this->framePools[this->currentFrame], 0)) {
+        throw std::runtime_error("failed to reset command pool!");
+    }
+    VkCommandBuffer commandBuffer = this->commandBuffers[this->currentFrame];
+    VkExtent2D extent = this->swapchain->swapChainExtent;
+    VkRect2D renderArea = {{0, 0}, extent};
+    if (this->partialRedraw) {
+        renderArea = alignRect(this->imageDamage[imageId], this->renderAreaGranularity, extent);
+    }
+    this->imageDamage[imageId] = {};
+    bool whole = renderArea.extent.width == extent.width && renderArea.extent.height == extent.height;
+    this->drawnPixels += static_cast<uint64_t>(renderArea.extent.width) * renderArea.extent.height;
+    this->framePixels += static_cast<uint64_t>(extent.width) * extent.height;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = nullptr;  // Optional
+
+    if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &beginInfo)) {
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
+    if (isEmpty(renderArea)) {
+        // up to date already (e.g. a capture of an unchanged frame), presented as it is
+        if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
             throw std::runtime_error("failed to record command buffer!");
         }
+        return;
+    }
+    VkRenderPassBeginInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    // the full pass discards the old contents, cheaper where there is nothing to keep
+    renderPassInfo.renderPass = whole ? this->swapchain->renderpass : this->swapchain->renderpassPartial;
+    renderPassInfo.framebuffer = this->swapchain->swapChainFrameBuffers[imageId];
+    renderPassInfo.renderArea = renderArea;
+
+    std::array<VkClearValue, 2> clearValues{};
+    clearValues[0].color = {0.1f, 0.1f, 0.1f, 1.0f};
+    clearValues[1].depthStencil = {1.0f, 0};
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    vkCmdBindPipeline(commandBuffer, this->pipelineBindType, this->pipeline);
+    vkCmdSetScissor(commandBuffer, 0, 1, &renderArea);
+    if (nullptr != this->textures) {
+        this->textures->bind(commandBuffer, this->pipelineLayout);
+    }
+
+    PushConstants pushConstants{};
+    if (nullptr != this->view) {
+        this->view->write(pushConstants);
+    }
+    if (this->contents) {
+        this->contents(commandBuffer, pushConstants);
+    }
+
+    vkCmdEndRenderPass(commandBuffer);
+    if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
+        throw std::runtime_error("failed to record command buffer!");
     }
 }
 
 VkResult Renderer::submitCommandBuffers(const VkCommandBuffer *buffer, uint32_t *imageId) {
     uint32_t &MAX_FRAMES_IN_FLIGHT = this->MAX_FRAMES_IN_FLIGHT;
 
-    VkFence &imageInFlight = this->imagesInFlight[*imageId];
-
-    if (VK_NULL_HANDLE != imageInFlight) {
-        vkWaitForFences(this->device->device, 1, &imageInFlight, VK_TRUE, UINT64_MAX);
+    // only the color output waits for the image; async compute results sampled from this frame on
+    // and deferred uploads are added by Device::submitGraphics, which also puts the uploads in front
+    std::vector<VkSemaphoreSubmitInfo> waits = {};
+    if (!this->offscreen) {
+        VkSemaphoreSubmitInfo imageAvailable{};
+        imageAvailable.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        imageAvailable.semaphore = this->imageAvailableSemaphores[this->currentFrame];
+        imageAvailable.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+        waits.push_back(imageAvailable);
     }
-    imageInFlight = this->inFlightFences[this->currentFrame];
-
-    VkSemaphore waitSemaphores[] = {this->imageAvailableSemaphores[this->currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
     VkSemaphore signalSemaphores[] = {this->renderFinishedSemaphores[this->currentFrame]};
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = buffer;
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+
+    // a captured frame is presented after its readback copy, which then signals renderFinished
+    int32_t captureSlot = (nullptr != this->readback) ? this->readback->beginCapture() : -1;
+    bool capturing = captureSlot >= 0;
+
+    std::vector<VkSemaphoreSubmitInfo> signals = {};
+    if (!this->offscreen && !capturing) {
+        VkSemaphoreSubmitInfo renderFinished{};
+        renderFinished.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        renderFinished.semaphore = signalSemaphores[0];
+        renderFinished.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+        signals.push_back(renderFinished);
+    }
 
     vkResetFences(this->device->device, 1, &this->inFlightFences[this->currentFrame]);
-    if (VK_SUCCESS != vkQueueSubmit(this->device->graphicsQueue, 1, &submitInfo, this->inFlightFences[this->currentFrame])) {
-        throw std::runtime_error("failed to submit draw command buffer!");
+    this->device->submitGraphics({*buffer}, waits, signals, this->inFlightFences[this->currentFrame]);
+    if (capturing) {
+        this->readback->submitCopy(captureSlot, *imageId, this->offscreen ? VK_NULL_HANDLE : signalSemaphores[0]);
     }
 
-    VkSwapchainKHR swapChains[] = {this->swapchain->swapchain};
-    VkPresentInfoKHR presentInfo = {};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapChains;
-    presentInfo.pImageIndices = imageId;
+    // one rect for what changed since the last present; without it the whole image counts as changed
+    Presenter::Request request{};
+    request.swapchain = this->swapchain->swapchain;
+    request.imageId = *imageId;
+    request.wait = signalSemaphores[0];
+    request.rect = {this->presentDamage.offset, this->presentDamage.extent, 0};
+    request.incremental = this->partialRedraw && this->device->hasIncrementalPresent && !isEmpty(this->presentDamage);
+    this->presentDamage = {};
+
+    if (this->offscreen) {
+        this->currentFrame = (this->currentFrame + 1) % this->MAX_FRAMES_IN_FLIGHT;
+        return VK_SUCCESS;
+    }
 
-    auto result = vkQueuePresentKHR(this->device->presentQueue, &presentInfo);
+    auto result = this->presenter->submit(request);
 
     this->currentFrame = (this->currentFrame + 1) % this->MAX_FRAMES_IN_FLIGHT;
 
@@ -165,14 +347,29 @@ VkResult Renderer::submitCommandBuffers(const VkCommandBuffer *buffer, uint32_t
 }
 
 void Renderer::drawFrame() {
+    if (nullptr != this->readback) {
+        this->readback->poll();
+    }
+
+    // a threaded present of the last frame has to be done before the swapchain is touched again
+    VkResult result = VK_SUCCESS;
+    if (!this->offscreen) {
+        result = this->presenter->wait();
+    }
+    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+        std::cerr << "present_result = " << result << std::endl;
+        throw std::runtime_error("failed to present swap chain image!");
+    }
 
     uint32_t imageId;
-    auto result = this->acquireNextImage(&imageId);
+    result = this->acquireNextImage(&imageId);
     if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
         throw std::runtime_error("failed to acquire swap chain image");
     }
 
-    result = this->submitCommandBuffers(&this->commandBuffers[imageId], &imageId);
+    this->recordCommandBuffer(imageId);
+
+    result = this->submitCommandBuffers(&this->commandBuffers[this->currentFrame], &imageId);
     if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
         std::cerr << "present_result = " << result << std::endl;
         throw std::runtime_error("failed to present swap chain image!");
@@ -0,0 +1,499 @@
+#include "types.hpp"
+#include <cstdint>
+#include <numeric>
+#include <vulkan/vulkan_core.h>
+
+// Passes are executed in the order they are added. Each declares what it reads and writes,
+// compile() drops passes nothing depends on and places transient images whose lifetimes don't
+// overlap into the same memory, execute() records the passes with the barriers in between.
+//
+// At the graph boundary the previous state of a resource is unknown, so its first use waits on
+// everything before it (ALL_COMMANDS / MEMORY_WRITE). Within the graph a barrier is emitted only
+// for write hazards, layout changes or reads not yet made visible, and all of a pass' barriers go
+// out in a single vkCmdPipelineBarrier2.
+
+struct AccessInfo {
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+    bool write;
+    VkImageUsageFlags usage;
+};
+
+static AccessInfo accessInfo(RenderGraph::Access access) {
+    switch (access) {
+        case RenderGraph::ACCESS_COLOR_ATTACHMENT_WRITE:
+            return {
+                VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+            };
+        case RenderGraph::ACCESS_DEPTH_ATTACHMENT_WRITE:
+            return {
+                VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+            };
+        case RenderGraph::ACCESS_FRAGMENT_SAMPLED_READ:
+            return {
+                VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, VK_IMAGE_USAGE_SAMPLED_BIT
+            };
+        case RenderGraph::ACCESS_COMPUTE_SAMPLED_READ:
+            return {
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, VK_IMAGE_USAGE_SAMPLED_BIT
+            };
+        case RenderGraph::ACCESS_COMPUTE_STORAGE_READ:
+            return {
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+                VK_IMAGE_LAYOUT_GENERAL, false, VK_IMAGE_USAGE_STORAGE_BIT
+            };
+        case RenderGraph::ACCESS_COMPUTE_STORAGE_WRITE:
+            return {
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                VK_IMAGE_LAYOUT_GENERAL, true, VK_IMAGE_USAGE_STORAGE_BIT
+            };
+        case RenderGraph::ACCESS_TRANSFER_READ:
+            return {
+                VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false, VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+            };
+        case RenderGraph::ACCESS_TRANSFER_WRITE:
+            return {
+                VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true, VK_IMAGE_USAGE_TRANSFER_DST_BIT
+            };
+        case RenderGraph::ACCESS_HOST_READ:
+            return {
+                VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT,
+                VK_IMAGE_LAYOUT_GENERAL, false, 0
+            };
+        case RenderGraph::ACCESS_NONE:
+            break;
+    }
+    return {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED, false, 0};
+}
+
+// #############
+//  DECLARATION
+// #############
+
+RenderGraph::ResourceId RenderGraph::importImage(
+    const std::string &name,
+    VkImage image,
+    VkImageView view,
+    VkImageLayout currentLayout,
+    Access finalAccess,
+    VkImageAspectFlags aspect
+) {
+    Resource resource{};
+    resource.name = name;
+    resource.isImage = true;
+    resource.imported = true;
+    resource.image = image;
+    resource.view = view;
+    resource.aspect = aspect;
+    resource.importLayout = currentLayout;
+    resource.finalAccess = finalAccess;
+    this->resources.push_back(resource);
+    this->compiled = false;
+    return static_cast<ResourceId>(this->resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::importBuffer(const std::string &name, VkBuffer buffer, Access finalAccess) {
+    Resource resource{};
+    resource.name = name;
+    resource.isImage = false;
+    resource.imported = true;
+    resource.buffer = buffer;
+    resource.finalAccess = finalAccess;
+    this->resources.push_back(resource);
+    this->compiled = false;
+    return static_cast<ResourceId>(this->resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::createImage(const std::string &name, const VkImageCreateInfo &imageInfo) {
+    Resource resource{};
+    resource.name = name;
+    resource.isImage = true;
+    resource.imported = false;
+    resource.imageInfo = imageInfo;
+    resource.imageInfo.usage = 0;
+    resource.imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    resource.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    this->resources.push_back(resource);
+    this->compiled = false;
+    return static_cast<ResourceId>(this->resources.size() - 1);
+}
+
+void RenderGraph::addPass(
+    const std::string &name,
+    const std::vector<Use> &reads,
+    const std::vector<Use> &writes,
+    RecordFunc record,
+    bool sideEffects
+) {
+    Pass pass{};
+    pass.name = name;
+    pass.reads = reads;
+    pass.writes = writes;
+    pass.record = std::move(record);
+    pass.sideEffects = sideEffects;
+    this->passes.push_back(std::move(pass));
+    this->compiled = false;
+}
+
+// #########
+//  COMPILE
+// #########
+
+void RenderGraph::cullPasses() {
+    // walk backwards from the outputs, a pass survives if something needed is written by it
+    std::vector<bool> needed(this->resources.size(), false);
+    for (size_t i = 0; i < this->resources.size(); i++) {
+        needed[i] = this->resources[i].imported && this->resources[i].finalAccess != ACCESS_NONE;
+    }
+    for (size_t p = this->passes.size(); p-- > 0;) {
+        Pass &pass = this->passes[p];
+        bool used = pass.sideEffects;
+        for (const Use &use : pass.writes) {
+            used = used || needed[use.resource];
+        }
+        pass.culled = !used;
+        if (pass.culled) {
+            if (debug) std::cout << "rendergraph: culled pass \"" << pass.name << "\"" << std::endl;
+            continue;
+        }
+        for (const Use &use : pass.reads) {
+            needed[use.resource] = true;
+        }
+    }
+}
+
+void RenderGraph::computeLifetimes() {
+    for (Resource &resource : this->resources) {
+        resource.firstPass = -1;
+        resource.lastPass = -1;
+    }
+    for (size_t p = 0; p < this->passes.size(); p++) {
+        Pass &pass = this->passes[p];
+        if (pass.culled) continue;
+        for (const std::vector<Use> *uses : {&pass.reads, &pass.writes}) {
+            for (const Use &use : *uses) {
+                Resource &resource = this->resources[use.resource];
+                if (resource.firstPass < 0) resource.firstPass = static_cast<int32_t>(p);
+                resource.lastPass = static_cast<int32_t>(p);
+                if (!resource.imported) {
+                    resource.imageInfo.usage |= accessInfo(use.access).usage;
+                }
+            }
+        }
+    }
+}
+
+void RenderGraph::allocateTransients() {
+    std::vector<ResourceId> transients = {};
+    std::vector<VkMemoryRequirements> requirements(this->resources.size());
+    for (ResourceId id = 0; id < this->resources.size(); id++) {
+        Resource &resource = this->resources[id];
+        if (resource.imported || resource.firstPass < 0) continue;
+        if (VK_SUCCESS != vkCreateImage(this->device->device, &resource.imageInfo, nullptr, &resource.image)) {
+            throw std::runtime_error("failed to create transient image!");
+        }
+        vkGetImageMemoryRequirements(this->device->device, resource.image, &requirements[id]);
+        transients.push_back(id);
+    }
+
+    // biggest first, each goes into the first block it fits: compatible memory type and
+    // no pass in which it and an image already in the block are both alive
+    std::sort(transients.begin(), transients.end(), [&](ResourceId a, ResourceId b) {
+        return requirements[a].size > requirements[b].size;
+    });
+    VkDeviceSize unaliasedSize = 0;
+    for (ResourceId id : transients) {
+        Resource &resource = this->resources[id];
+        unaliasedSize += requirements[id].size;
+        for (size_t b = 0; b <= this->blocks.size(); b++) {
+            if (b == this->blocks.size()) {
+                this->blocks.push_back(Block{});
+            }
+            Block &block = this->blocks[b];
+            if (0 == (block.memoryTypeBits & requirements[id].memoryTypeBits)) continue;
+            bool overlaps = false;
+            for (ResourceId other : block.images) {
+                const Resource &o = this->resources[other];
+                overlaps = overlaps || (resource.firstPass <= o.lastPass && o.firstPass <= resource.lastPass);
+            }
+            if (overlaps) continue;
+
+            block.images.push_back(id);
+            block.memoryTypeBits &= requirements[id].memoryTypeBits;
+            block.size = std::max(block.size, requirements[id].size);
+            resource.block = static_cast<int32_t>(b);
+            break;
+        }
+    }
+
+    TransientHeap *heap = this->heap;
+    if (nullptr == heap) {
+        heap = &this->ownHeap;
+    }
+    heap->device = this->device;
+    for (uint32_t b = 0; b < this->blocks.size(); b++) {
+        Block &block = this->blocks[b];
+        VkDeviceMemory memory = heap->acquire(b, block.size, block.memoryTypeBits);
+        for (ResourceId id : block.images) {
+            Resource &resource = this->resources[id];
+            if (VK_SUCCESS != vkBindImageMemory(this->device->device, resource.image, memory, 0)) {
+                throw std::runtime_error("failed to bind transient image memory!");
+            }
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = resource.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = resource.imageInfo.format;
+            viewInfo.subresourceRange.aspectMask = resource.aspect;
+            viewInfo.subresourceRange.baseMipLevel = 0;
+            viewInfo.subresourceRange.levelCount = resource.imageInfo.mipLevels;
+            viewInfo.subresourceRange.baseArrayLayer = 0;
+            viewInfo.subresourceRange.layerCount = resource.imageInfo.arrayLayers;
+            if (VK_SUCCESS != vkCreateImageView(this->device->device, &viewInfo, nullptr, &resource.view)) {
+                throw std::runtime_error("failed to create transient image view!");
+            }
+        }
+    }
+
+    if (debug && !transients.empty()) {
+        std::cout << "rendergraph: " << transients.size() << " transient images in " << this->blocks.size()
+                  << " blocks, " << transientMemorySize() << " bytes (" << unaliasedSize << " without aliasing)"
+                  << std::endl;
+    }
+}
+
+void RenderGraph::compile() {
+    if (this->compiled) return;
+    cullPasses();
+    computeLifetimes();
+    allocateTransients();
+    this->compiled = true;
+}
+
+VkDeviceSize RenderGraph::transientMemorySize() {
+    VkDeviceSize size = 0;
+    for (const Block &block : this->blocks) {
+        size += block.size;
+    }
+    return size;
+}
+
+// ######
+//  HEAP
+// ######
+
+VkDeviceMemory RenderGraph::TransientHeap::acquire(uint32_t block, VkDeviceSize size, uint32_t typeBits) {
+    if (block >= this->allocations.size()) {
+        this->allocations.resize(block + 1);
+    }
+    Allocation &allocation = this->allocations[block];
+    bool fits = VK_NULL_HANDLE != allocation.memory && allocation.size >= size &&
+        0 != (typeBits & (1u << allocation.memoryType));
+    if (fits) {
+        return allocation.memory;
+    }
+    if (VK_NULL_HANDLE != allocation.memory) {
+        VkDeviceMemory memory = allocation.memory;
+        this->device->retire([device = this->device, memory]() {
+            vkFreeMemory(device->device, memory, nullptr);
+        });
+    }
+    // never shrinks, zooming back and forth settles on one allocation
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = std::max(size, allocation.size);
+    allocInfo.memoryTypeIndex = this->device->findMemoryType(typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (VK_SUCCESS != vkAllocateMemory(this->device->device, &allocInfo, nullptr, &allocation.memory)) {
+        allocation.memory = VK_NULL_HANDLE;
+        throw std::runtime_error("failed to allocate transient memory!");
+    }
+    allocation.size = allocInfo.allocationSize;
+    allocation.memoryType = allocInfo.memoryTypeIndex;
+    this->allocationCount++;
+    return allocation.memory;
+}
+
+void RenderGraph::TransientHeap::destroy() {
+    for (Allocation &allocation : this->allocations) {
+        vkFreeMemory(this->device->device, allocation.memory, nullptr);
+    }
+    this->allocations.clear();
+}
+
+// ##########
+//  EXECUTE
+// ##########
+
+void RenderGraph::transition(ResourceId id, Access access) {
+    if (access == ACCESS_NONE) return;
+    Resource &resource = this->resources[id];
+    State &state = resource.state;
+    AccessInfo info = accessInfo(access);
+
+    VkImageLayout newLayout = resource.isImage ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+    bool layoutChange = resource.isImage && newLayout != state.layout;
+
+    VkPipelineStageFlags2 srcStages = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 srcAccess = VK_ACCESS_2_NONE;
+    bool barrier = false;
+
+    if (info.write || layoutChange) {
+        // write-after-write, write-after-read, or the layout transition (itself a write)
+        srcStages = state.writeStages | state.readStages;
+        srcAccess = state.writeAccess;
+        barrier = layoutChange || srcStages != VK_PIPELINE_STAGE_2_NONE;
+
+        state.writeStages = info.stages;
+        state.writeAccess = info.write ? info.access : VK_ACCESS_2_NONE;
+        state.readStages = info.write ? VK_PIPELINE_STAGE_2_NONE : info.stages;
+        // a new write is visible to nobody yet; a layout change alone was made visible to this access
+        state.visibleStages = info.write ? VK_PIPELINE_STAGE_2_NONE : info.stages;
+        state.visibleAccess = info.write ? VK_ACCESS_2_NONE : info.access;
+    } else {
+        // read-after-read needs nothing, read-after-write only if not made visible to this stage yet
+        bool visible = (info.stages & ~state.visibleStages) == 0 && (info.access & ~state.visibleAccess) == 0;
+        if (!visible && state.writeStages != VK_PIPELINE_STAGE_2_NONE) {
+            srcStages = state.writeStages;
+            srcAccess = state.writeAccess;
+            barrier = true;
+        }
+        state.readStages |= info.stages;
+        if (barrier || state.writeStages == VK_PIPELINE_STAGE_2_NONE) {
+            state.visibleStages |= info.stages;
+            state.visibleAccess |= info.access;
+        }
+    }
+
+    if (resource.block >= 0) {
+        Block &block = this->blocks[resource.block];
+        block.lastStages |= info.stages;
+        if (info.write) block.lastAccess |= info.access;
+    }
+    if (!barrier) return;
+
+    if (resource.isImage) {
+        VkImageMemoryBarrier2 imageBarrier{};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        imageBarrier.srcStageMask = srcStages;
+        imageBarrier.srcAccessMask = srcAccess;
+        imageBarrier.dstStageMask = info.stages;
+        imageBarrier.dstAccessMask = info.access;
+        imageBarrier.oldLayout = state.layout;
+        imageBarrier.newLayout = newLayout;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = resource.image;
+        imageBarrier.subresourceRange.aspectMask = resource.aspect;
+        imageBarrier.subresourceRange.baseMipLevel = 0;
+        imageBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        imageBarrier.subresourceRange.baseArrayLayer = 0;
+        imageBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        this->imageBarriers.push_back(imageBarrier);
+        state.layout = newLayout;
+    } else {
+        VkBufferMemoryBarrier2 bufferBarrier{};
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        bufferBarrier.srcStageMask = srcStages;
+        bufferBarrier.srcAccessMask = srcAccess;
+        bufferBarrier.dstStageMask = info.stages;
+        bufferBarrier.dstAccessMask = info.access;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.buffer = resource.buffer;
+        bufferBarrier.offset = 0;
+        bufferBarrier.size = VK_WHOLE_SIZE;
+        this->bufferBarriers.push_back(bufferBarrier);
+    }
+}
+
+uint32_t RenderGraph::flushBarriers(VkCommandBuffer commandBuffer) {
+    uint32_t count = static_cast<uint32_t>(this->imageBarriers.size() + this->bufferBarriers.size());
+    if (0 == count) return 0;
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(this->bufferBarriers.size());
+    dependencyInfo.pBufferMemoryBarriers = this->bufferBarriers.data();
+    dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(this->imageBarriers.size());
+    dependencyInfo.pImageMemoryBarriers = this->imageBarriers.data();
+    vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+    this->imageBarriers.clear();
+    this->bufferBarriers.clear();
+    return count;
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer) {
+    compile();
+
+    // unknown history: earlier submissions may still use imported resources and transient memory
+    for (Resource &resource : this->resources) {
+        resource.state = State{};
+        if (resource.imported) {
+            resource.state.layout = resource.importLayout;
+            resource.state.writeStages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            resource.state.writeAccess = VK_ACCESS_2_MEMORY_WRITE_BIT;
+        }
+    }
+    for (Block &block : this->blocks) {
+        block.lastStages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        block.lastAccess = VK_ACCESS_2_MEMORY_WRITE_BIT;
+    }
+
+    for (Pass &pass : this->passes) {
+        if (pass.culled) continue;
+        for (const std::vector<Use> *uses : {&pass.reads, &pass.writes}) {
+            for (const Use &use : *uses) {
+                Resource &resource = this->resources[use.resource];
+                if (resource.block >= 0 && resource.firstPass == static_cast<int32_t>(&pass - this->passes.data())) {
+                    // first use of an aliased image, whatever used the memory before has to be done
+                    Block &block = this->blocks[resource.block];
+                    resource.state.writeStages = block.lastStages;
+                    resource.state.writeAccess = block.lastAccess;
+                    block.lastStages = VK_PIPELINE_STAGE_2_NONE;
+                    block.lastAccess = VK_ACCESS_2_NONE;
+                }
+                transition(use.resource, use.access);
+            }
+        }
+        uint32_t barriers = flushBarriers(commandBuffer);
+        if (debug) {
+            std::cout << "rendergraph: pass \"" << pass.name << "\" after " << barriers << " barriers" << std::endl;
+        }
+        pass.record(commandBuffer, *this);
+    }
+
+    for (ResourceId id = 0; id < this->resources.size(); id++) {
+        Resource &resource = this->resources[id];
+        if (resource.imported && resource.finalAccess != ACCESS_NONE) {
+            transition(id, resource.finalAccess);
+            // the next execute starts from there
+            resource.importLayout = resource.state.layout;
+        }
+    }
+    flushBarriers(commandBuffer);
+}
+
+void RenderGraph::destroy() {
+    for (Resource &resource : this->resources) {
+        if (resource.imported) continue;
+        vkDestroyImageView(this->device->device, resource.view, nullptr);
+        vkDestroyImage(this->device->device, resource.image, nullptr);
+    }
+    this->ownHeap.destroy();
+    this->resources.clear();
+    this->passes.clear();
+    this->blocks.clear();
+    this->compiled = false;
+}
@@ -0,0 +1,115 @@
+#include "types.hpp"
+#include <cstdint>
+#include <sys/resource.h>
+
+// The window loop used to draw back to back whatever happened, pinning a core. Now it sleeps in
+// SDL_WaitEventTimeout until something invalidates the frame. Background threads wake it with a
+// registered SDL user event (SDL_PushEvent is thread safe), so they never touch the loop's state.
+
+// user + system time of the whole process, every thread included
+static double processCpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+void RedrawScheduler::create() {
+    this->wakeEventType = SDL_RegisterEvents(1);
+    if (this->wakeEventType == static_cast<uint32_t>(-1)) {
+        throw std::runtime_error("failed to register the redraw SDL event");
+    }
+    this->dirty = true;
+    this->startTime = std::chrono::steady_clock::now();
+    this->startCpuS = processCpuSeconds();
+}
+
+void RedrawScheduler::invalidate() {
+    this->dirty = true;
+}
+
+void RedrawScheduler::post() {
+    SDL_Event event{};
+    event.type = this->wakeEventType;
+    SDL_PushEvent(&event);
+}
+
+bool RedrawScheduler::waitEvent(SDL_Event &event) {
+    if (this->needsFrame()) {
+        // the frame cap sleeps before the events are read, not after, so the frame that follows
+        // is built from the freshest input
+        if (this->fpsCap > 0) {
+            auto now = std::chrono::steady_clock::now();
+            if (now < this->nextFrameTime) {
+                std::this_thread::sleep_until(this->nextFrameTime);
+            }
+            auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(1.0 / this->fpsCap));
+            // no catching up after a stall, the schedule restarts from now
+            this->nextFrameTime = std::max(this->nextFrameTime, now) + period;
+        }
+        return SDL_PollEvent(&event) == 1;
+    }
+
+    auto waitStart = std::chrono::steady_clock::now();
+    double cpuStart = processCpuSeconds();
+    int got = SDL_WaitEventTimeout(&event, static_cast<int>(this->idleTimeoutMs));
+    auto waitEnd = std::chrono::steady_clock::now();
+    this->idleWallS += std::chrono::duration<double>(waitEnd - waitStart).count();
+    this->idleCpuS += processCpuSeconds() - cpuStart;
+
+    if (got == 1) {
+        // latency is counted from here, if the event turns out to dirty the frame
+        this->wakeTime = waitEnd;
+        this->wakePending = true;
+        this->wakeCount++;
+    }
+    return got == 1;
+}
+
+void RedrawScheduler::framePresented() {
+    if (this->wakePending) {
+        auto now = std::chrono::steady_clock::now();
+        double latency = std::chrono::duration<double, std::milli>(now - this->wakeTime).count();
+        this->latenciesMs[this->latencyCount % LATENCY_WINDOW] = latency;
+        this->latencyCount++;
+        this->latencySumMs += latency;
+        this->latencyMaxMs = std::max(this->latencyMaxMs, latency);
+        this->wakePending = false;
+    }
+    this->dirty = false;
+    this->frameCount++;
+}
+
+void RedrawScheduler::frameSkipped() {
+    this->wakePending = false;
+    this->dirty = false;
+}
+
+void RedrawScheduler::report() {
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->startTime).count();
+    double cpu = processCpuSeconds() - this->startCpuS;
+    if (wall <= 0.0) return;
+
+    std::cout << "redraw: " << this->frameCount << " frames in " << wall << " s, process cpu "
+              << 100.0 * cpu / wall << "% of a core" << std::endl;
+    if (this->idleWallS > 0.0) {
+        std::cout << "redraw: idle " << 100.0 * this->idleWallS / wall << "% of the time, process cpu while idle "
+                  << 100.0 * this->idleCpuS / this->idleWallS << "% of a core, " << this->wakeCount << " wakeups"
+                  << std::endl;
+    }
+    if (this->latencyCount > 0) {
+        size_t windowSize = static_cast<size_t>(std::min(this->latencyCount, static_cast<uint64_t>(LATENCY_WINDOW)));
+        std::vector<double> sorted(this->latenciesMs.begin(), this->latenciesMs.begin() + windowSize);
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&sorted](double p) {
+            return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+        };
+        std::cout << "redraw: wake -> present " << this->latencySumMs / this->latencyCount << " ms mean, "
+                  << percentile(0.5) << " ms p50, " << percentile(0.99) << " ms p99";
+        if (windowSize < this->latencyCount) {
+            std::cout << " (of the last " << windowSize << ")";
+        }
+        std::cout << ", " << this->latencyMaxMs << " ms max (" << this->latencyCount << " frames)" << std::endl;
+    }
+}
@@ -3,12 +3,28 @@
 
 #include "main.vert.h" // present by CMake
 #include "main.frag.h" // present by CMake
+#include "sheet.vert.h" // present by CMake
+#include "sheet.frag.h" // present by CMake
 
 void Pipeline::createShaderModules() {
     VkShaderModuleCreateInfo vertShaderCI{};
     vertShaderCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    vertShaderCI.codeSize = sizeof(vertShaderCode);
-    vertShaderCI.pCode = vertShaderCode;
+    VkShaderModuleCreateInfo fragShaderCI{};
+    fragShaderCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    switch (this->shaders) {
+        case SHADERS_SIMPLE:
+            vertShaderCI.codeSize = sizeof(vertShaderCode);
+            vertShaderCI.pCode = vertShaderCode;
+            fragShaderCI.codeSize = sizeof(fragShaderCode);
+            fragShaderCI.pCode = fragShaderCode;
+            break;
+        case SHADERS_SHEET:
+            vertShaderCI.codeSize = sizeof(sheetVertShaderCode);
+            vertShaderCI.pCode = sheetVertShaderCode;
+            fragShaderCI.codeSize = sizeof(sheetFragShaderCode);
+            fragShaderCI.pCode = sheetFragShaderCode;
+            break;
+    }
     if(debug) {
         std::cout << "Vertex shader code size: " << vertShaderCI.codeSize << " bytes" << std::endl;
     }
@@ -23,10 +39,6 @@ void Pipeline::createShaderModules() {
     }
 
 
-    VkShaderModuleCreateInfo fragShaderCI{};
-    fragShaderCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    fragShaderCI.codeSize = sizeof(fragShaderCode);
-    fragShaderCI.pCode = fragShaderCode;
     if(debug) {
         std::cout << "Fragment shader code size: " << fragShaderCI.codeSize << " bytes" << std::endl;
     }
@@ -0,0 +1,86 @@
+#include "types.hpp"
+#include <cstdint>
+#include <cstdio>
+
+// The image used to be decoded in full before the window, instance, device, swapchain and
+// pipelines were even started, although none of them need its pixels. Now the decode runs as a
+// job from the beginning and run_app joins it only right before the texture is created. The
+// timeline records which thread ran what and when, so the overlap can be read off the report.
+
+double StartupTimeline::nowMs() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - this->origin).count();
+}
+
+void StartupTimeline::start() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->origin = std::chrono::steady_clock::now();
+    this->mainThread = std::this_thread::get_id();
+    this->phases.clear();
+    this->current = -1;
+    this->finishMs = 0.0;
+}
+
+uint32_t StartupTimeline::begin(const std::string &name) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    Phase phase{};
+    phase.name = name;
+    phase.main = std::this_thread::get_id() == this->mainThread;
+    phase.startMs = this->nowMs();
+    this->phases.push_back(phase);
+    return static_cast<uint32_t>(this->phases.size() - 1);
+}
+
+void StartupTimeline::end(uint32_t phase) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (phase < this->phases.size()) {
+        this->phases[phase].endMs = this->nowMs();
+    }
+}
+
+void StartupTimeline::next(const std::string &name) {
+    if (this->current >= 0) {
+        this->end(static_cast<uint32_t>(this->current));
+    }
+    this->current = static_cast<int32_t>(this->begin(name));
+}
+
+void StartupTimeline::finish() {
+    if (this->current >= 0) {
+        this->end(static_cast<uint32_t>(this->current));
+        this->current = -1;
+    }
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->finishMs = this->nowMs();
+}
+
+void StartupTimeline::report() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->phases.empty() || this->finishMs <= 0.0) return;
+
+    // a phase still running (a worker that outlived the start) is drawn up to the end
+    double total = this->finishMs;
+    double busy = 0.0;
+    for (const Phase &phase : this->phases) {
+        double end = phase.endMs < 0.0 ? total : phase.endMs;
+        total = std::max(total, end);
+        busy += end - phase.startMs;
+    }
+
+    const int COLUMNS = 40;
+    std::cout << "startup: ready after " << this->finishMs << " ms" << std::endl;
+    for (const Phase &phase : this->phases) {
+        double end = phase.endMs < 0.0 ? total : phase.endMs;
+        int first = static_cast<int>(COLUMNS * phase.startMs / total);
+        int last = std::max(first + 1, static_cast<int>(COLUMNS * end / total + 0.5));
+        std::string bar(COLUMNS, ' ');
+        for (int i = first; i < std::min(last, COLUMNS); i++) bar[i] = '#';
+        char line[160];
+        snprintf(line, sizeof(line), "startup:   %-18s %-6s |%s| %8.1f .. %8.1f ms%s", phase.name.c_str(),
+                 phase.main ? "main" : "worker", bar.c_str(), phase.startMs, end,
+                 phase.endMs < 0.0 ? " (running)" : "");
+        std::cout << line << std::endl;
+    }
+    // more phase time than wall time is what running them side by side bought
+    std::cout << "startup: phases add up to " << busy << " ms, " << std::max(0.0, busy - this->finishMs)
+              << " ms of it overlapped" << std::endl;
+}
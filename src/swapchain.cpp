@@ -13,23 +13,72 @@ VkSurfaceFormatKHR SwapChain::chooseSwapSurfaceFormat (App *app) {
     return app->device.swapchainSupport.formats[0];
 }
 
+const char *SwapChain::presentModeName(VkPresentModeKHR mode) {
+    switch (mode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:    return "Immediate";
+        case VK_PRESENT_MODE_MAILBOX_KHR:      return "Mailbox";
+        case VK_PRESENT_MODE_FIFO_KHR:         return "V-Sync";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "V-Sync (relaxed)";
+        default:                               return "other";
+    }
+}
+
+bool SwapChain::parsePresentPolicy(const std::string &name, PresentPolicy &policy) {
+    if (name == "low-latency") {
+        policy = PRESENT_LOW_LATENCY;
+    } else if (name == "vsync") {
+        policy = PRESENT_VSYNC;
+    } else if (name == "max-throughput") {
+        policy = PRESENT_MAX_THROUGHPUT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
 VkPresentModeKHR SwapChain::chooseSwapPresentMode(App *app) {
-    for (const auto &availablePresentMode : app->device.swapchainSupport.presentModes) {
-        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-            if (app->debug) std::cout << "Present mode: Mailbox" << std::endl;
-            return availablePresentMode;
-        }
+    // preference order per policy, FIFO is the one mode every implementation has
+    std::vector<VkPresentModeKHR> preferred = {};
+    switch (this->presentPolicy) {
+        case PRESENT_LOW_LATENCY:
+            // newest frame wins without tearing; IMMEDIATE tears but still beats a FIFO queue
+            preferred = {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
+            break;
+        case PRESENT_VSYNC:
+            preferred = {};
+            break;
+        case PRESENT_MAX_THROUGHPUT:
+            preferred = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+            break;
     }
 
-    //for (const auto &availablePresentMode : app->swapchainSupport.presentModes) {
-    //    if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-    //        if (app->debug) std::cout << "Present mode: Immediate" << std::endl;
-    //        return availablePresentMode;
-    //    }
-    //}
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    for (VkPresentModeKHR mode : preferred) {
+        const std::vector<VkPresentModeKHR> &available = app->device.swapchainSupport.presentModes;
+        if (std::find(available.begin(), available.end(), mode) != available.end()) {
+            presentMode = mode;
+            break;
+        }
+    }
+    if (app->debug) std::cout << "Present mode: " << presentModeName(presentMode) << std::endl;
+    return presentMode;
+}
 
-    if (app->debug) std::cout << "Present mode: V-Sync" << std::endl;
-    return VK_PRESENT_MODE_FIFO_KHR;
+// images the presentation engine may hold on to, besides the one being rendered
+uint32_t SwapChain::chooseImageCount(App *app, VkPresentModeKHR presentMode) {
+    const VkSurfaceCapabilitiesKHR &capabilities = app->device.swapchainSupport.capabilities;
+    uint32_t count = capabilities.minImageCount + 1;
+    if (this->presentPolicy == PRESENT_LOW_LATENCY && presentMode == VK_PRESENT_MODE_FIFO_KHR) {
+        // every queued image is a frame of latency under FIFO
+        count = capabilities.minImageCount;
+    } else if (this->presentPolicy == PRESENT_MAX_THROUGHPUT) {
+        // the GPU never waits for an image to come back
+        count = capabilities.minImageCount + 2;
+    }
+    if (capabilities.maxImageCount > 0 && count > capabilities.maxImageCount) {
+        count = capabilities.maxImageCount;
+    }
+    return count;
 }
 
 VkExtent2D SwapChain::chooseSwapExtent(App *app) {
@@ -51,6 +100,7 @@ VkExtent2D SwapChain::chooseSwapExtent(App *app) {
 
 void SwapChain::destroySwapChain() {
     vkDestroySwapchainKHR(this->device->device, this->swapchain, nullptr);
+    this->swapchain = VK_NULL_HANDLE;
 }
 void SwapChain::createSwapChain(App *app) {
 
@@ -58,11 +108,7 @@ void SwapChain::createSwapChain(App *app) {
     VkPresentModeKHR presentMode = chooseSwapPresentMode(app);
     VkExtent2D extent = chooseSwapExtent(app);
 
-    this->imageCount = app->device.swapchainSupport.capabilities.minImageCount + 1;
-    if (app->device.swapchainSupport.capabilities.maxImageCount > 0 &&
-        imageCount > app->device.swapchainSupport.capabilities.maxImageCount) {
-        imageCount = app->device.swapchainSupport.capabilities.maxImageCount;
-    }
+    this->imageCount = chooseImageCount(app, presentMode);
 
     //VkSwapchainCreateInfoKHR &createInfo = this->SwapChainCI;
     VkSwapchainCreateInfoKHR createInfo{};
@@ -75,13 +121,18 @@ void SwapChain::createSwapChain(App *app) {
     createInfo.imageExtent = extent;
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    if (app->device.swapchainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) {
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT; // framebuffer readback
+    }
     
+    uint32_t queueFamilyIndices[] = {
+        app->device.queueFamilies.graphicsFamily,
+        app->device.queueFamilies.presentFamily
+    };
     if (app->device.queueFamilies.graphicsFamily != app->device.queueFamilies.presentFamily) {
         createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
         createInfo.queueFamilyIndexCount = 2;
-        createInfo.pQueueFamilyIndices = reinterpret_cast<uint32_t*>(
-           app->device.queueFamilies.graphicsFamily // + presentFamily
-        );
+        createInfo.pQueueFamilyIndices = queueFamilyIndices;
     } else {
         createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
         createInfo.queueFamilyIndexCount = 0;      // Optional
@@ -94,12 +145,16 @@ void SwapChain::createSwapChain(App *app) {
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
 
-    createInfo.oldSwapchain = nullptr;
-    //this->SwapChainCI.oldSwapchain = oldSwapChain == nullptr ? VK_NULL_HANDLE : oldSwapChain->swapChain;
+    // on recreation the old swapchain is handed over, so its resources can be reused
+    VkSwapchainKHR oldSwapchain = this->swapchain;
+    createInfo.oldSwapchain = oldSwapchain;
 
     if (vkCreateSwapchainKHR(app->device.device, &(createInfo), nullptr, &(this->swapchain)) != VK_SUCCESS) {
       throw std::runtime_error("failed to create swap chain");
     }
+    if (VK_NULL_HANDLE != oldSwapchain) {
+        vkDestroySwapchainKHR(app->device.device, oldSwapchain, nullptr);
+    }
 
     // we only specified a minimum number of images in the swap chain, so the implementation is
     // allowed to create a swap chain with more. That's why we'll first query the final number of
@@ -111,7 +166,73 @@ void SwapChain::createSwapChain(App *app) {
     vkGetSwapchainImagesKHR(app->device.device, this->swapchain, &(this->imageCount), this->swapChainImages.data());
 
     this->swapChainImageFormat = surfaceFormat.format;
+    this->swapChainImageUsage = createInfo.imageUsage;
     this->swapChainExtent = extent;
+    this->presentMode = presentMode;
+}
+
+// new present mode / image count with everything else (render pass, pipelines) kept; the format
+// and the extent stay the same, so only the per-image objects are rebuilt
+void SwapChain::recreateSwapChain(App *app) {
+    vkDeviceWaitIdle(this->device->device);
+    destroyFrameBuffers();
+    destroyDepthImagesViewsMemorys();
+    destroyImageViews();
+
+    createSwapChain(app);
+    createImageViews();
+    createDepthImagesViewsMemorys();
+    createFrameBuffers();
+}
+
+void SwapChain::destroyOffscreenImages() {
+    for (size_t i = 0; i < this->swapChainImages.size(); i++) {
+        vkDestroyImage(this->device->device, this->swapChainImages[i], nullptr);
+        vkFreeMemory(this->device->device, this->swapChainImageMemorys[i], nullptr);
+    }
+    this->swapChainImages.clear();
+    this->swapChainImageMemorys.clear();
+}
+void SwapChain::createOffscreenImages(App *app) {
+    // headless stand-in for createSwapChain: plain color images the rest of
+    // the swapchain objects (views, render pass, framebuffers) are built upon
+    this->swapChainImageFormat = device->findSupportedFormat(
+        {VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB},
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT
+    );
+    this->swapChainExtent = app->windowExtent;
+    this->swapChainImageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    this->finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    this->imageCount = app->renderer.MAX_FRAMES_IN_FLIGHT + 1;
+
+    this->swapChainImages.resize(this->imageCount);
+    this->swapChainImageMemorys.resize(this->imageCount);
+    for (size_t i = 0; i < this->imageCount; i++) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = this->swapChainExtent.width;
+        imageInfo.extent.height = this->swapChainExtent.height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = this->swapChainImageFormat;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = this->swapChainImageUsage;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.flags = 0;
+
+        device->createImage(
+            imageInfo,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            this->swapChainImages[i],
+            this->swapChainImageMemorys[i]
+        );
+    }
+    if (app->debug) std::cout << "Present mode: Headless" << std::endl;
 }
 
 
@@ -143,14 +264,20 @@ void SwapChain::createImageViews() {
 
 void SwapChain::destroyRenderPass() {
     vkDestroyRenderPass  (this->device->device, this->renderpass, nullptr);
+    vkDestroyRenderPass  (this->device->device, this->renderpassPartial, nullptr);
 }
 void SwapChain::createRenderPass() {
+    bool hasDepth = this->depthMode != DEPTH_NONE;
+    if (hasDepth) {
+        this->swapChainDepthFormat = device->findSupportedFormat(
+            {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+        );
+    }
+
     VkAttachmentDescription depthAttachment{};
-    depthAttachment.format = device->findSupportedFormat(
-        {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
-    );
+    depthAttachment.format = this->swapChainDepthFormat;
     depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
     depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -171,7 +298,7 @@ void SwapChain::createRenderPass() {
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = this->finalLayout;
 
     VkAttachmentReference colorAttachmentRef = {};
     colorAttachmentRef.attachment = 0;
@@ -181,20 +308,29 @@ void SwapChain::createRenderPass() {
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
-    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+    subpass.pDepthStencilAttachment = hasDepth ? &depthAttachmentRef : nullptr;
 
     VkSubpassDependency dependency = {};
     dependency.dstSubpass = 0;
-    dependency.dstAccessMask =
-        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    dependency.dstStageMask =
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.srcAccessMask = 0;
-    dependency.srcStageMask =
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    if (hasDepth) {
+        // a shared depth image is written by consecutive frames, order the previous frame's
+        // depth writes (late tests) before this frame's clear
+        dependency.dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependency.dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependency.srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependency.srcStageMask |=
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    }
 
-    std::array<VkAttachmentDescription,2> renderPassAttachments = {colorAttachment, depthAttachment};
+    std::vector<VkAttachmentDescription> renderPassAttachments = {colorAttachment};
+    if (hasDepth) {
+        renderPassAttachments.push_back(depthAttachment);
+    }
     VkRenderPassCreateInfo renderPassInfo = {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     renderPassInfo.attachmentCount = static_cast<uint32_t>(renderPassAttachments.size());
@@ -207,6 +343,16 @@ void SwapChain::createRenderPass() {
     if (VK_SUCCESS != vkCreateRenderPass(this->device->device, &renderPassInfo, nullptr, &(this->renderpass))) {
         throw std::runtime_error("failed to create render pass!");
     }
+
+    // what is outside the render area has to survive the layout transition
+    renderPassAttachments[0].initialLayout = this->finalLayout;
+    if (VK_SUCCESS != vkCreateRenderPass(this->device->device, &renderPassInfo, nullptr, &(this->renderpassPartial))) {
+        throw std::runtime_error("failed to create partial render pass!");
+    }
+    this->attachments = {colorAttachment};
+    if (hasDepth) {
+        this->attachments.push_back(depthAttachment);
+    }
 }
 
 void SwapChain::destroyDepthImagesViewsMemorys() {
@@ -215,19 +361,22 @@ void SwapChain::destroyDepthImagesViewsMemorys() {
         vkDestroyImage(this->device->device, this->depthImages[i], nullptr);
         vkFreeMemory(this->device->device, this->depthImageMemorys[i], nullptr);
     }
+    this->depthImages.clear();
+    this->depthImageMemorys.clear();
+    this->depthImageViews.clear();
 }
 void SwapChain::createDepthImagesViewsMemorys() {
-    
-    this->swapChainDepthFormat = device->findSupportedFormat(
-          {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
-          VK_IMAGE_TILING_OPTIMAL,
-          VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
-    );
+    // depth is cleared on load and never stored, so it is a transient attachment: on tilers it can
+    // live in tile memory only (LAZILY_ALLOCATED), elsewhere one image can serve all framebuffers
+    if (this->depthMode == DEPTH_NONE) {
+        return;
+    }
     VkExtent2D swapChainExtent = this->swapChainExtent;
+    size_t depthImageCount = (this->depthMode == DEPTH_SHARED) ? 1 : this->imageCount;
     
-    this->depthImages.resize(this->imageCount);
-    this->depthImageMemorys.resize(this->imageCount);
-    this->depthImageViews.resize(this->imageCount);
+    this->depthImages.resize(depthImageCount);
+    this->depthImageMemorys.resize(depthImageCount);
+    this->depthImageViews.resize(depthImageCount);
 
     for (int i = 0; i < depthImages.size(); i++) {
         VkImageCreateInfo imageInfo{};
@@ -241,14 +390,20 @@ void SwapChain::createDepthImagesViewsMemorys() {
         imageInfo.format = this->swapChainDepthFormat;
         imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
         imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
         imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
         imageInfo.flags = 0;
 
+        // no lazily allocated memory type on desktop GPUs
+        VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        if (device->hasMemoryType(
+                device->imageMemoryTypes(imageInfo), properties | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+            properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        }
         device->createImage(
             imageInfo,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            properties,
             depthImages[i],
             depthImageMemorys[i]
         );
@@ -278,7 +433,12 @@ void SwapChain::destroyFrameBuffers() {
 void SwapChain::createFrameBuffers() {
     swapChainFrameBuffers.resize(this->imageCount);
     for (size_t i = 0; i < this->imageCount; i++) {
-        std::array<VkImageView, 2> attachments = {swapChainImageViews[i], depthImageViews[i]};
+        std::vector<VkImageView> attachments = {swapChainImageViews[i]};
+        if (this->depthMode == DEPTH_SHARED) {
+            attachments.push_back(depthImageViews[0]);
+        } else if (this->depthMode == DEPTH_PER_IMAGE) {
+            attachments.push_back(depthImageViews[i]);
+        }
 
         VkFramebufferCreateInfo framebufferInfo = {};
         framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -0,0 +1,159 @@
+#include "types.hpp"
+#include <cstdint>
+#include <vulkan/vulkan_core.h>
+
+// Descriptor indexing (core since 1.2, enabled in Device::pickPhysicalDevice):
+//  - update-after-bind: slots are written while command buffers using the set are recorded/pending
+//  - partially bound: slots nobody allocated are never written, only the used ones have to be valid
+// so the set is bound once per command buffer and a new texture is one vkUpdateDescriptorSets.
+
+void TextureHeap::create() {
+    VkPhysicalDeviceVulkan12Properties props12{};
+    props12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 props{};
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props.pNext = &props12;
+    vkGetPhysicalDeviceProperties2(this->device->physicalDevice, &props);
+
+    // combined image samplers count as a sampled image and a sampler, both bindings share the limits
+    uint32_t limit = std::min({
+        props12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        props12.maxPerStageDescriptorUpdateAfterBindSamplers,
+        props12.maxDescriptorSetUpdateAfterBindSampledImages,
+        props12.maxDescriptorSetUpdateAfterBindSamplers,
+        props12.maxPerStageUpdateAfterBindResources
+    }) / BINDING_COUNT;
+    this->capacity = std::min(this->capacity, limit);
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    if (VK_SUCCESS != vkCreateSampler(this->device->device, &samplerInfo, nullptr, &this->sampler)) {
+        throw std::runtime_error("failed to create sampler!");
+    }
+
+    std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings{};
+    std::array<VkDescriptorBindingFlags, BINDING_COUNT> bindingFlags{};
+    for (uint32_t i = 0; i < BINDING_COUNT; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[i].descriptorCount = this->capacity;
+        bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+        bindingFlags[i] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                          VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                          VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    }
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = BINDING_COUNT;
+    bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = BINDING_COUNT;
+    layoutInfo.pBindings = bindings.data();
+    if (VK_SUCCESS != vkCreateDescriptorSetLayout(this->device->device, &layoutInfo, nullptr, &this->descriptorSetLayout)) {
+        throw std::runtime_error("failed to create texture heap descriptor set layout!");
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = this->capacity * BINDING_COUNT;
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (VK_SUCCESS != vkCreateDescriptorPool(this->device->device, &poolInfo, nullptr, &this->descriptorPool)) {
+        throw std::runtime_error("failed to create texture heap descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = this->descriptorPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &this->descriptorSetLayout;
+    if (VK_SUCCESS != vkAllocateDescriptorSets(this->device->device, &allocateInfo, &this->descriptorSet)) {
+        throw std::runtime_error("failed to allocate texture heap descriptor set!");
+    }
+
+    for (uint32_t i = 0; i < BINDING_COUNT; i++) {
+        this->freeSlots[i].clear();
+        this->nextSlot[i] = 0;
+    }
+    if (debug) {
+        std::cout << "texture heap: " << this->capacity << " slots per binding" << std::endl;
+    }
+}
+
+void TextureHeap::destroy() {
+    vkDestroyDescriptorPool(this->device->device, this->descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(this->device->device, this->descriptorSetLayout, nullptr);
+    vkDestroySampler(this->device->device, this->sampler, nullptr);
+    this->descriptorPool = VK_NULL_HANDLE;
+    this->descriptorSetLayout = VK_NULL_HANDLE;
+    this->descriptorSet = VK_NULL_HANDLE;
+    this->sampler = VK_NULL_HANDLE;
+}
+
+uint32_t TextureHeap::allocate(Binding binding, VkImageView view, VkImageLayout layout) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    // recycled slots first, keeps the used part of the arrays dense
+    uint32_t slot;
+    std::vector<uint32_t> &freeSlots = this->freeSlots[binding];
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else if (this->nextSlot[binding] < this->capacity) {
+        slot = this->nextSlot[binding]++;
+    } else {
+        throw std::runtime_error("texture heap is full!");
+    }
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.sampler = this->sampler;
+    imageInfo.imageView = view;
+    imageInfo.imageLayout = layout;
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = this->descriptorSet;
+    write.dstBinding = binding;
+    write.dstArrayElement = slot;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(this->device->device, 1, &write, 0, nullptr);
+    return slot;
+}
+
+void TextureHeap::release(Binding binding, uint32_t slot) {
+    // the descriptor keeps pointing at the old view, partially bound lets it dangle until reuse
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->freeSlots[binding].push_back(slot);
+}
+
+uint32_t TextureHeap::allocatedCount(Binding binding) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->nextSlot[binding] - static_cast<uint32_t>(this->freeSlots[binding].size());
+}
+
+void TextureHeap::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VkPipelineBindPoint bindPoint) {
+    vkCmdBindDescriptorSets(
+        commandBuffer,
+        bindPoint,
+        pipelineLayout,
+        0,
+        1, &this->descriptorSet,
+        0, nullptr
+    );
+}
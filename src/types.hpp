@@ -21,6 +21,16 @@
 #include <SDL2/SDL_stdinc.h>
 #include <cstdint>
 #include <set>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <unordered_map>
 
 inline bool debug = false;
 
@@ -30,8 +40,10 @@ inline bool isequal(const char* a, const char* b) { return strcmp(a, b) == 0; };
 struct QueueFamilyIndices {
     uint32_t graphicsFamily;
     uint32_t presentFamily;
+    uint32_t computeFamily;     // a compute-only family if there is one, else the graphics family
     bool graphicsFamilyHasValue = false;
     bool presentFamilyHasValue = false;
+    bool computeFamilyHasValue = false;
     bool isComplete() {
         return graphicsFamilyHasValue && presentFamilyHasValue;
     }
@@ -48,6 +60,8 @@ struct SwapChainSupportDetails {
 
 
 struct App;
+struct PushConstants;
+class JobSystem;
 
 class Instance {
 public:
@@ -72,15 +86,29 @@ public:
     VkDevice device = VK_NULL_HANDLE;
     VkQueue graphicsQueue = VK_NULL_HANDLE;
     VkQueue presentQueue = VK_NULL_HANDLE;
+    VkQueue computeQueue = VK_NULL_HANDLE;   // async compute, the graphics queue if there is no such family
+    // the queues above may all be one VkQueue; whatever submits to or presents on one while another
+    // thread may do the same (the present thread) holds queueMutex(queue), the same mutex for
+    // every name of that VkQueue, so a blocking present only holds up submits to the queue it is on
+    std::mutex &queueMutex(VkQueue queue);
     VkCommandPool commandPool = VK_NULL_HANDLE;
 
     std::vector<const char*> deviceExtensions = {};
+    // requested in pickPhysicalDevice, devices lacking any of them are skipped
+    VkPhysicalDeviceFeatures2 enabledFeatures = {};
+    VkPhysicalDeviceVulkan12Features enabledFeatures12 = {};
+    VkPhysicalDeviceVulkan13Features enabledFeatures13 = {};
 
     SwapChainSupportDetails swapchainSupport = {};
     QueueFamilyIndices queueFamilies = {};
 
 
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    // for picking between property flags up front, where findMemoryType would throw
+    bool hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    // memory types a buffer / an image made from these would accept, without creating one
+    uint32_t bufferMemoryTypes(VkDeviceSize size, VkBufferUsageFlags usage);
+    uint32_t imageMemoryTypes(const VkImageCreateInfo &imageInfo);
     VkFormat findSupportedFormat(
         const std::vector<VkFormat> &candidates,
         VkImageTiling tiling,
@@ -100,6 +128,38 @@ public:
     );
     void createCommandPool();
     void destroyCommandPool();
+    // one-off recording on the graphics queue, end waits until it and everything submitted before
+    // it is done
+    VkCommandBuffer beginSingleTimeCommands();
+    void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+
+    // signaled by every submitGraphics, created with the command pool
+    VkSemaphore graphicsTimeline = VK_NULL_HANDLE;
+    uint64_t graphicsSubmitCount = 0;       // vkQueueSubmit2 calls
+    uint64_t deferredCommandCount = 0;      // command buffers that rode along in one of them
+    // recorded work that needs no submission of its own (uploads): it goes out in front of the
+    // command buffers of the next submitGraphics and is freed once that is done
+    void deferGraphicsCommands(VkCommandBuffer commandBuffer);
+    // one vkQueueSubmit2 of the deferred command buffers and commandBuffers, waiting on waits and
+    // the pending graphics waits each at its own stages, signaling signals and graphicsTimeline;
+    // the timeline value it signals
+    uint64_t submitGraphics(
+        const std::vector<VkCommandBuffer> &commandBuffers,
+        std::vector<VkSemaphoreSubmitInfo> waits,
+        std::vector<VkSemaphoreSubmitInfo> signals,
+        VkFence fence
+    );
+    // for another queue about to read what deferred command buffers write: submits them if they
+    // are still pending; the graphicsTimeline value to wait for, 0 - nothing to wait for
+    uint64_t flushDeferredGraphics();
+    void waitGraphics(uint64_t value);
+    // deferred destruction of objects replaced while frames are in flight: destroy runs once
+    // graphicsTimeline reaches the last submitGraphics so far, so every frame that could still use
+    // them is done; due ones are collected at every submitGraphics. Main thread only
+    void retire(std::function<void()> destroy);
+    // runs what is due; all - everything, the device has to be idle
+    void collectRetired(bool all);
+    uint64_t retiredCount = 0;      // destroyed through retire()
     void createBuffer(
         VkDeviceSize size,
         VkBufferUsageFlags usage,
@@ -109,19 +169,77 @@ public:
     );
     void destroyBuffer(VkBuffer buffer);
 
+    bool hasAsyncCompute() { return this->queueFamilies.computeFamily != this->queueFamilies.graphicsFamily; }
+    // VK_KHR_incremental_present, enabled by create() where available
+    bool hasIncrementalPresent = false;
+    // VK_EXT_external_memory_host, enabled by create() where available; imported host pointers
+    // have to be aligned to hostPointerAlignment
+    bool hasExternalMemoryHost = false;
+    VkDeviceSize hostPointerAlignment = 0;
+    // host memory as a transfer source buffer, nothing is copied; pointer and size have to be
+    // multiples of hostPointerAlignment and the mapping has to outlive the buffer
+    void importHostBuffer(void *pointer, VkDeviceSize size, VkBuffer &buffer, VkDeviceMemory &memory);
+    // images touched by both the graphics and the async compute queue, saves ownership transfers
+    void setConcurrentSharing(VkImageCreateInfo &imageInfo);
+    // a semaphore signaled on another queue (async compute), the next graphics queue submission
+    // waits on it; later submissions are ordered after that one
+    void addGraphicsWait(VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags stages);
+    void takeGraphicsWaits(
+        std::vector<VkSemaphore> &semaphores,
+        std::vector<uint64_t> &values,
+        std::vector<VkPipelineStageFlags> &stages
+    );
+
 private:
+    std::vector<uint32_t> sharingFamilies = {};
+    std::mutex graphicsQueueMutex;
+    std::mutex computeQueueMutex;
+    std::mutex presentQueueMutex;
+    std::mutex graphicsWaitsMutex;
+    std::vector<VkSemaphore> graphicsWaitSemaphores = {};
+    std::vector<uint64_t> graphicsWaitValues = {};
+    std::vector<VkPipelineStageFlags> graphicsWaitStages = {};
+    uint64_t graphicsTimelineValue = 0;
+    uint64_t lastDeferredValue = 0;         // timeline value of the last submission that had some
+    std::vector<VkCommandBuffer> deferredCommands = {};
+    std::deque<std::pair<uint64_t, std::function<void()>>> retired = {};    // run once reached
+
+    std::optional<uint32_t> matchMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
     bool isPhysicalDeviceSuitble(App *app, VkPhysicalDevice phdev);
     bool areDeviceFeaturesSupported(VkPhysicalDevice phdev);
-    bool areDeviceExtensionsSupported(VkPhysicalDevice phdev);
+    bool areDeviceExtensionsSupported(VkPhysicalDevice phdev, const std::vector<const char*> &extensions);
     QueueFamilyIndices findQueueFamilies(App *app, VkPhysicalDevice phdev);
     SwapChainSupportDetails querySwapChainSupport(App *app, VkPhysicalDevice phdev);
 };
 
 class SwapChain {
 public:
+    // how the render pass' depth attachment is backed
+    enum DepthMode {
+        DEPTH_NONE,       // no depth attachment at all (2D)
+        DEPTH_SHARED,     // one transient image for every framebuffer
+        DEPTH_PER_IMAGE,  // one transient image per swapchain image
+    };
+
+    // what the present mode and the image count are picked for, switchable at runtime
+    enum PresentPolicy {
+        PRESENT_LOW_LATENCY,     // MAILBOX, else IMMEDIATE, else FIFO with as few images as allowed
+        PRESENT_VSYNC,           // FIFO, no tearing, the GPU is throttled to the display
+        PRESENT_MAX_THROUGHPUT,  // IMMEDIATE, else MAILBOX, with an extra image to render into
+        PRESENT_POLICY_COUNT
+    };
+
     Device *device = nullptr;
+    DepthMode depthMode = DEPTH_NONE;
     VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+    PresentPolicy presentPolicy = PRESENT_LOW_LATENCY;
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
     VkRenderPass renderpass = VK_NULL_HANDLE;
+    // compatible with renderpass, but starts from the image's last contents (initialLayout =
+    // finalLayout), for redraws of part of it; the load op only clears inside the render area
+    VkRenderPass renderpassPartial = VK_NULL_HANDLE;
+    // of renderpass; formats and samples are the same in renderpassPartial
+    std::vector<VkAttachmentDescription> attachments = {};
 
     uint32_t imageCount = 0;
     std::vector<VkImage> swapChainImages = {};
@@ -130,39 +248,229 @@ public:
     std::vector<VkImageView> depthImageViews = {};
     std::vector<VkDeviceMemory> depthImageMemorys = {};
     std::vector<VkFramebuffer> swapChainFrameBuffers = {};
+    // only used in headless mode, where the images are not owned by a VkSwapchainKHR
+    std::vector<VkDeviceMemory> swapChainImageMemorys = {};
 
     VkFormat swapChainImageFormat = {};
+    VkImageUsageFlags swapChainImageUsage = 0;
     VkFormat swapChainDepthFormat = {};
     VkExtent2D swapChainExtent = {};
+    VkImageLayout finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     void createSwapChain(App *app);
+    void createOffscreenImages(App *app);
     void createImageViews();
     void createRenderPass();
     void createDepthImagesViewsMemorys();
     void createFrameBuffers();
 
     void destroySwapChain();
+    void destroyOffscreenImages();
     void destroyImageViews();
     void destroyRenderPass();
     void destroyDepthImagesViewsMemorys();
     void destroyFrameBuffers();
 
+    // new present mode / image count, render pass and pipelines stay valid
+    void recreateSwapChain(App *app);
+
+    static bool parsePresentPolicy(const std::string &name, PresentPolicy &policy);
+    static const char *presentModeName(VkPresentModeKHR mode);
 
 private:
     VkExtent2D chooseSwapExtent(App *app);
     VkPresentModeKHR chooseSwapPresentMode(App *app);
+    uint32_t chooseImageCount(App *app, VkPresentModeKHR presentMode);
     VkSurfaceFormatKHR chooseSwapSurfaceFormat (App *app);
 
 };
 
+class RenderGraph {
+public:
+    // how a pass touches a resource, decides stages, access masks and image layouts
+    enum Access {
+        ACCESS_NONE,
+        ACCESS_COLOR_ATTACHMENT_WRITE,
+        ACCESS_DEPTH_ATTACHMENT_WRITE,
+        ACCESS_FRAGMENT_SAMPLED_READ,
+        ACCESS_COMPUTE_SAMPLED_READ,
+        ACCESS_COMPUTE_STORAGE_READ,
+        ACCESS_COMPUTE_STORAGE_WRITE,
+        ACCESS_TRANSFER_READ,
+        ACCESS_TRANSFER_WRITE,
+        ACCESS_HOST_READ,
+    };
+    typedef uint32_t ResourceId;
+    struct Use {
+        ResourceId resource;
+        Access access;
+    };
+    typedef std::function<void(VkCommandBuffer commandBuffer, RenderGraph &graph)> RecordFunc;
+
+    // device memory behind the transient images, kept across graphs built one after another (a
+    // graph per Downscaler run) so their compiles do not allocate; grows to the biggest block asked
+    // for, outgrown memory is retired (Device::retire) as graphs in flight may still use it
+    class TransientHeap {
+    public:
+        Device *device = nullptr;
+        uint64_t allocationCount = 0;   // vkAllocateMemory calls
+
+        // at least size bytes of a DEVICE_LOCAL type in typeBits for the graph's block-th block
+        VkDeviceMemory acquire(uint32_t block, VkDeviceSize size, uint32_t typeBits);
+        // the device has to be done with every graph that used it
+        void destroy();
+
+    private:
+        struct Allocation {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            VkDeviceSize size = 0;
+            uint32_t memoryType = 0;
+        };
+        std::vector<Allocation> allocations = {};
+    };
+
+    Device *device = nullptr;
+    // nullptr - the graph allocates memory of its own, freed by destroy()
+    TransientHeap *heap = nullptr;
+
+    // imported resources are owned elsewhere, finalAccess != ACCESS_NONE marks them as graph outputs
+    ResourceId importImage(
+        const std::string &name,
+        VkImage image,
+        VkImageView view,
+        VkImageLayout currentLayout,
+        Access finalAccess = ACCESS_NONE,
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT
+    );
+    ResourceId importBuffer(const std::string &name, VkBuffer buffer, Access finalAccess = ACCESS_NONE);
+    // transient images live only within the graph, their memory is aliased where lifetimes allow;
+    // usage is filled in from the passes using them
+    ResourceId createImage(const std::string &name, const VkImageCreateInfo &imageInfo);
+
+    // sideEffects: kept even if nothing it writes is consumed (e.g. host readback)
+    void addPass(
+        const std::string &name,
+        const std::vector<Use> &reads,
+        const std::vector<Use> &writes,
+        RecordFunc record,
+        bool sideEffects = false
+    );
+
+    void compile();
+    void execute(VkCommandBuffer commandBuffer);
+    void destroy();
+
+    VkImage getImage(ResourceId id) { return this->resources[id].image; }
+    VkImageView getImageView(ResourceId id) { return this->resources[id].view; }
+    VkBuffer getBuffer(ResourceId id) { return this->resources[id].buffer; }
+    VkDeviceSize transientMemorySize();
+
+private:
+    struct State {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+        VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;   // since the last write
+        VkPipelineStageFlags2 visibleStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 visibleAccess = VK_ACCESS_2_NONE;
+    };
+    struct Resource {
+        std::string name;
+        bool isImage = true;
+        bool imported = false;
+        Access finalAccess = ACCESS_NONE;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+        VkImageCreateInfo imageInfo = {};
+        VkImageLayout importLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        int32_t firstPass = -1;
+        int32_t lastPass = -1;
+        int32_t block = -1;        // aliasing block of a transient image
+        State state = {};
+    };
+    struct Pass {
+        std::string name;
+        std::vector<Use> reads;
+        std::vector<Use> writes;
+        RecordFunc record;
+        bool sideEffects = false;
+        bool culled = false;
+    };
+    struct Block {
+        VkDeviceSize size = 0;
+        uint32_t memoryTypeBits = ~0u;
+        std::vector<ResourceId> images = {};
+        VkPipelineStageFlags2 lastStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 lastAccess = VK_ACCESS_2_NONE;
+    };
+
+    std::vector<Resource> resources = {};
+    std::vector<Pass> passes = {};
+    std::vector<Block> blocks = {};
+    TransientHeap ownHeap = {};     // used without a heap
+    std::vector<VkImageMemoryBarrier2> imageBarriers = {};
+    std::vector<VkBufferMemoryBarrier2> bufferBarriers = {};
+    bool compiled = false;
+
+    void cullPasses();
+    void computeLifetimes();
+    void allocateTransients();
+    void transition(ResourceId id, Access access);
+    // the number of barriers recorded
+    uint32_t flushBarriers(VkCommandBuffer commandBuffer);
+};
+
+// one global descriptor set holding every sampled texture (descriptor indexing: update-after-bind,
+// partially bound). Shaders index it with PushConstants::textureIndex, so nothing is rebound per image.
+class TextureHeap {
+public:
+    // one runtime sized array per sampler type, a slot is an index into one of them
+    enum Binding {
+        BINDING_2D = 0,         // sampler2D textures[]
+        BINDING_2D_ARRAY = 1,   // sampler2DArray textureArrays[]
+        BINDING_COUNT
+    };
+
+    Device *device = nullptr;
+    uint32_t capacity = 4096;   // slots per binding, clamped to the device limits by create()
+
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+
+    void create();
+    void destroy();
+    // the view has to outlive the slot; thread safe
+    uint32_t allocate(Binding binding, VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // the GPU must be done with the slot, it is handed out again
+    void release(Binding binding, uint32_t slot);
+    uint32_t allocatedCount(Binding binding);
+    void bind(
+        VkCommandBuffer commandBuffer,
+        VkPipelineLayout pipelineLayout,
+        VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS
+    );
+
+private:
+    std::mutex mutex;
+    std::array<std::vector<uint32_t>, BINDING_COUNT> freeSlots = {};
+    std::array<uint32_t, BINDING_COUNT> nextSlot = {};
+};
+
 struct StbImage {
+    // what stbi decoded into pixels: 8 or 16 bit sRGB encoded RGBA, or linear float RGB (Radiance HDR)
+    enum Depth { DEPTH_8, DEPTH_16, DEPTH_FLOAT };
 
     std::string path;
-    stbi_uc* pixels;
+    void *pixels;
     int texWidth;
     int texHeight;
-    int texChannels;
-    VkDeviceSize size;
+    int texChannels;                // in the file
+    Depth depth = DEPTH_8;
+    VkDeviceSize size;              // of the texels on the GPU, known once the format is picked
 
 };
 
@@ -174,6 +482,7 @@ public:
     };
     std::vector <Vertex> vertices{};
     Device *device = nullptr;
+    JobSystem *jobs = nullptr;      // converts the pixels to texels in parallel, if set
     VkBuffer vertexBuffer = VK_NULL_HANDLE;
     VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
 
@@ -185,15 +494,55 @@ public:
     VkDeviceSize textureStagingSize;
     VkImage textureImage;
     VkDeviceMemory textureMemory;
+    VkImageView textureView = VK_NULL_HANDLE;
+    // the smallest supported format that keeps the decoded precision, picked by createTextureObjects
+    VkFormat textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+    uint32_t textureIndex = 0;          // TextureHeap::BINDING_2D slot
+    uint32_t displayIndex = 0;          // what is drawn: textureIndex or a Downscaler copy of it
 
     size_t maxVertexCount = 0;
     uint32_t vertexCount = 0;
 
     int loadImageSTBI();
+    VkFormat chooseTextureFormat();
     void createTextureObjects();
     void destroyTextureObjects();
     void writeTextureToGPU();
 
+    // pixels another process wrote into shared host memory, laid out like the texture (textureFormat,
+    // tightly packed rows, the texture's size) and aligned to Device::hostPointerAlignment. The memory
+    // is imported as a buffer once per pointer and the GPU copies it into textureImage, the CPU never
+    // touches the pixels. The memory may be overwritten once Device::graphicsTimeline reaches the
+    // returned value (0 - right away). Results derived from the texture (Downscaler, Adjuster) are not
+    // refreshed here
+    uint64_t ingestHostPixels(void *pixels, VkDeviceSize size);
+    // forgets the import of pixels, before that memory is unmapped; waits for the last copy from it
+    void releaseHostPixels(void *pixels);
+    // called by ingestHostPixels before the copy is submitted, so reads of textureImage on other
+    // queues (Adjuster, Histogram) are waited for by it (Device::addGraphicsWait)
+    std::function<void()> beforeIngest = nullptr;
+    struct HostImport {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint64_t lastUse = 0;       // graphicsTimeline value of the last copy from it
+    };
+    std::unordered_map<void*, HostImport> hostImports = {};
+
+    static void recordTextureUpload(
+        VkCommandBuffer commandBuffer,
+        VkBuffer stagingBuffer,
+        VkImage image,
+        uint32_t width,
+        uint32_t height,
+        RenderGraph::Access finalAccess
+    );
+
+    // on-screen size of the whole texture at the given zoom, from the vertices' position / texCoord spans
+    VkExtent2D displayExtent(VkExtent2D viewExtent, float zoom);
+    // pixels of viewExtent the vertices cover under the view transform, clamped to it
+    VkRect2D screenRect(VkExtent2D viewExtent, float zoom, glm::vec2 pan);
+
     void createVertexBuffers(size_t maxVertexCount);
     void writeVertexBuffers(const std::vector<Vertex> &vertices);
     void destroyVertexBuffers();
@@ -204,6 +553,591 @@ public:
 };
 
 
+// skyline rect packer over pages of one size: each page keeps the lower edge of what is placed so
+// far as a list of horizontal segments, a rect goes where its bottom ends up closest to the top
+class AtlasPacker {
+public:
+    struct Placement {
+        uint32_t page = 0;
+        VkOffset2D offset = {0, 0};
+    };
+
+    VkExtent2D pageExtent = {0, 0};
+    uint32_t padding = 1;           // texels kept free right of and below every rect (filtering)
+    uint64_t usedArea = 0;          // of the rects, padding excluded
+
+    void reset(VkExtent2D pageExtent);
+    // the first page with room, a new one if none has it; false if it is bigger than a page
+    bool insert(VkExtent2D extent, Placement &placement);
+    uint32_t pageCount() { return static_cast<uint32_t>(this->skylines.size()); }
+
+private:
+    struct Segment {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+    };
+    std::vector<std::vector<Segment>> skylines = {};
+
+    // y of a width x height rect whose left edge is at segment i, -1 if it does not fit
+    int32_t fitAt(const std::vector<Segment> &skyline, size_t i, int32_t width, int32_t height);
+    bool insertInto(std::vector<Segment> &skyline, int32_t width, int32_t height, VkOffset2D &offset);
+};
+
+// many images as thumbnails in one texture array atlas, drawn as a grid with a single instanced draw
+class ContactSheet {
+public:
+    struct Instance {
+        glm::vec4 rect;     // xy - top left corner, zw - size, in NDC
+        glm::vec2 uvScale;  // part of the page covered by the thumbnail
+        uint32_t layer;     // atlas page
+        glm::vec2 uvOffset; // top left corner of the thumbnail on the page
+    };
+
+    Device *device = nullptr;
+    std::vector<std::string> paths = {};
+    VkExtent2D cellExtent = {256, 256};     // thumbnails fit into it
+    VkExtent2D pageExtent = {2048, 2048};   // atlas page (texture array layer), clamped to the device
+    float spacing = 0.05f;                  // gap between cells, fraction of the cell
+
+    VkImage textureImage = VK_NULL_HANDLE;
+    VkDeviceMemory textureMemory = VK_NULL_HANDLE;
+    VkImageView textureView = VK_NULL_HANDLE;
+    uint32_t textureIndex = 0;              // TextureHeap::BINDING_2D_ARRAY slot
+
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+    VkBuffer instanceBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory instanceBufferMemory = VK_NULL_HANDLE;
+    void *instanceData = nullptr;
+    uint32_t instanceCount = 0;
+
+    void create();
+    void destroy();
+    // decodes (as jobs of jobs) and downscales paths into atlas pages (BatchProcessor), ends up
+    // ready for sampling
+    void loadThumbnails(JobSystem *jobs);
+    // rewrites the instance buffer so the grid fills viewExtent
+    void layout(VkExtent2D viewExtent);
+
+    static std::vector<VkVertexInputBindingDescription> getVertexBindingDescriptions();
+    static std::vector<VkVertexInputAttributeDescription> getVertexAttributeDescriptions();
+    // pushConstants carries the view, the array's textureIndex is filled in
+    void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, PushConstants &pushConstants);
+    void draw(VkCommandBuffer commandBuffer);
+
+private:
+    uint32_t layerCount = 0;            // pages the array has room for, grows as they fill up
+    uint32_t maxLayerCount = 0;
+    AtlasPacker atlas{};
+    std::vector<VkExtent2D> thumbnailExtents = {};
+    std::vector<AtlasPacker::Placement> placements = {};
+
+    void createArray(uint32_t layers, VkImage &image, VkDeviceMemory &memory, VkImageView &view);
+    // copies the pages over into an array of layers pages, the new ones cleared
+    void resizeArray(uint32_t layers);
+};
+
+// display resolution copy of a big texture, filtered properly instead of bilinear minification:
+// separable box / Lanczos3 compute passes (shaders/downscale.comp.glsl) into an RGBA16F image.
+// Reruns only when the wanted extent changes, i.e. on zoom; in between frames sample the copy.
+class Downscaler {
+public:
+    enum Filter {
+        FILTER_NONE,        // always sample the source
+        FILTER_BOX,
+        FILTER_LANCZOS3,
+    };
+
+    Device *device = nullptr;
+    TextureHeap *textures = nullptr;
+    Filter filter = FILTER_LANCZOS3;
+
+    // the source has to be ready for ACCESS_FRAGMENT_SAMPLED_READ and sits in a BINDING_2D slot
+    VkImage sourceImage = VK_NULL_HANDLE;
+    uint32_t sourceIndex = 0;
+    VkExtent2D sourceExtent = {};
+
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    uint32_t textureIndex = 0;          // BINDING_2D slot of image
+    VkExtent2D extent = {0, 0};         // of image, {0, 0} - none yet
+    uint64_t runCount = 0;
+
+    void create();
+    void destroy();
+    // heap slot to sample for a texture drawn at displayExtent; dispatches only if the extent
+    // differs from the last one, the old copy is retired and kept for reuse at its extent
+    uint32_t update(VkExtent2D displayExtent);
+    // same extent, other contents (e.g. an Adjuster result); the next update() runs again
+    void setSource(VkImage image, uint32_t index);
+
+    static bool parseFilter(const std::string &name, Filter &filter);
+
+private:
+    struct Output {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        uint32_t textureIndex = 0;
+        VkExtent2D extent = {0, 0};
+    };
+    // a run's storage images; rewritten only once Device::graphicsTimeline passed its last run
+    struct RunSet {
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        uint64_t lastUse = 0;
+    };
+
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    std::array<RunSet, 4> runSets = {};
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkShaderModule shaderModule = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    RenderGraph::TransientHeap heap = {};   // the intermediate image of every run
+    std::vector<Output> spares = {};        // replaced copies no frame samples any more, oldest first
+    bool stale = false;                     // setSource since the last run
+
+    RunSet &nextRunSet();
+    Output takeOutput(VkExtent2D extent);
+    void destroyOutput(const Output &output);
+    void destroyImage();
+};
+
+// one thread blocking on the timeline semaphores of the compute jobs (Adjuster, Histogram) and
+// running a callback once a value is reached; a thread per job would be started for every dispatch
+class TimelineWaiter {
+public:
+    Device *device = nullptr;
+    uint64_t callbackCount = 0;     // waits that were reached
+
+    void create();
+    void destroy();
+    // callback runs on the waiter thread once semaphore reaches value
+    void add(VkSemaphore semaphore, uint64_t value, std::function<void()> callback);
+    // drops the waits on semaphore and returns once none of its callbacks runs any more
+    void remove(VkSemaphore semaphore);
+
+private:
+    struct Wait {
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        uint64_t value = 0;
+        std::function<void()> callback = nullptr;
+    };
+
+    std::thread worker;
+    std::mutex mutex;               // guards everything below
+    std::condition_variable changed;
+    std::vector<Wait> waits = {};
+    bool stopping = false;
+    bool running = false;           // callbacks are being run, outside the mutex
+    // signaled from the host by add() and destroy(), so a wait in progress returns and sees them
+    VkSemaphore wake = VK_NULL_HANDLE;
+    uint64_t wakeValue = 0;
+
+    void signalWake();
+    void work();
+};
+
+// exposure / contrast / levels / curve / sharpening over a texture, on the async compute queue
+// (shaders/adjust.comp.glsl). request() never waits: while a job runs only the newest parameters
+// are kept, poll() picks up finished jobs. Results are cached per parameter set, the tone stage
+// separately from sharpening, so scrubbing one slider redoes only the stage it affects.
+class Adjuster {
+public:
+    struct Params {
+        float exposure = 0.0f;          // stops
+        float contrast = 1.0f;
+        float black = 0.0f;             // levels
+        float white = 1.0f;
+        float gamma = 1.0f;
+        std::vector<float> curve = {};  // 256 entries over [0, 1], empty - identity
+        float sharpen = 0.0f;
+    };
+
+    Device *device = nullptr;
+    TextureHeap *textures = nullptr;
+    VkDeviceSize cacheBudget = 512ull << 20;    // bytes of cached results, least recently used go first
+
+    // has to be readable by the compute queue (Device::setConcurrentSharing), in a BINDING_2D slot
+    VkImage sourceImage = VK_NULL_HANDLE;
+    uint32_t sourceIndex = 0;
+    VkExtent2D sourceExtent = {};
+
+    uint64_t dispatchCount = 0;     // stages run on the GPU
+    uint64_t cacheHitCount = 0;     // stages served from the cache
+
+    void create();
+    void destroy();
+    void request(const Params &params);
+    // true if result() changed since the last call
+    bool poll();
+    // the adjusted image, the source until the first job is done; {image, BINDING_2D slot}
+    std::pair<VkImage, uint32_t> result();
+    bool busy() { return this->job.active; }
+    // sourceImage is about to be overwritten by the graphics queue: the next submission there waits
+    // for a running job
+    void beforeSourceWrite();
+
+    static bool isIdentity(const Params &params);
+    // "x:y,x:y,..." control points in [0, 1], linearly interpolated into Params::curve
+    static bool parseCurve(const std::string &text, std::vector<float> &curve);
+
+    // called on the waiter's thread when a job is done, e.g. RedrawScheduler::post
+    std::function<void()> notify = nullptr;
+    TimelineWaiter *waiter = nullptr;
+    // called before a shown result is destroyed, to finish reads other than the graphics queue's
+    std::function<void(VkImage)> releaseImage = nullptr;
+
+private:
+    struct Entry {
+        uint64_t key = 0;
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        VkImageView storageView = VK_NULL_HANDLE;   // UNORM, written
+        VkImageView sampledView = VK_NULL_HANDLE;   // sRGB, read
+        uint32_t textureIndex = 0;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        bool shown = false;         // handed out by result(), the graphics queue may be reading it
+        uint64_t lastUse = 0;
+    };
+    struct Job {
+        bool active = false;
+        uint64_t timelineValue = 0;
+        Entry *tone = nullptr;
+        Entry *result = nullptr;
+    };
+
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkShaderModule shaderModule = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkSemaphore timeline = VK_NULL_HANDLE;
+    uint64_t timelineValue = 0;
+    VkBuffer curveBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory curveMemory = VK_NULL_HANDLE;
+    void *curveData = nullptr;
+
+    std::vector<std::unique_ptr<Entry>> entries = {};
+    Entry *current = nullptr;       // what result() returns, nullptr - the source
+    Job job = {};
+    Params pending = {};
+    bool hasPending = false;
+    bool changed = false;
+    uint64_t useCounter = 0;
+
+    void start();
+    Entry *find(uint64_t key);
+    Entry *createEntry(uint64_t key);
+    void destroyEntry(Entry *entry);
+    void evict(uint32_t reserve);
+};
+
+class Histogram {
+public:
+    enum Channel { CHANNEL_RED, CHANNEL_GREEN, CHANNEL_BLUE, CHANNEL_LUMA, CHANNEL_COUNT };
+    static const uint32_t BIN_COUNT = 256;
+
+    // over sRGB-encoded values in [0, 1], luma is Rec. 709 of those
+    struct Stats {
+        VkImage image = VK_NULL_HANDLE;     // what was measured
+        uint64_t pixelCount = 0;
+        std::array<std::array<uint32_t, BIN_COUNT>, CHANNEL_COUNT> bins = {};
+        std::array<float, CHANNEL_COUNT> min = {};
+        std::array<float, CHANNEL_COUNT> max = {};
+        std::array<float, CHANNEL_COUNT> mean = {};
+
+        // the lowest bin value at or below which at least fraction of the pixels are
+        float percentile(Channel channel, float fraction) const;
+    };
+
+    Device *device = nullptr;
+    TextureHeap *textures = nullptr;
+
+    // subgroup vote and arithmetic in compute shaders, checked by create(); requests are ignored without
+    bool supported = false;
+    uint64_t dispatchCount = 0;
+
+    void create();
+    void destroy();
+    // an image in a BINDING_2D slot, readable by the compute queue; while a job runs the newest
+    // request waits, older ones are dropped
+    void request(VkImage image, uint32_t index, VkExtent2D extent);
+    // true once per finished job, stats are its results
+    bool poll(Stats &stats);
+    // image is about to be destroyed: a queued request for it is dropped, a running one waited for
+    void release(VkImage image);
+    // image is about to be overwritten by the graphics queue: the next submission there waits for a
+    // running job that reads it
+    void beforeWrite(VkImage image);
+    bool busy() { return this->job.active; }
+
+    // called on the waiter's thread when a job is done, e.g. RedrawScheduler::post
+    std::function<void()> notify = nullptr;
+    TimelineWaiter *waiter = nullptr;
+
+private:
+    struct Job {
+        bool active = false;
+        uint64_t timelineValue = 0;
+        VkImage image = VK_NULL_HANDLE;
+        uint32_t index = 0;
+        VkExtent2D extent = {};
+    };
+
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkShaderModule shaderModule = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkSemaphore timeline = VK_NULL_HANDLE;
+    uint64_t timelineValue = 0;
+    // atomics go to device local memory, copied into host visible memory at the end
+    VkBuffer resultBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory resultMemory = VK_NULL_HANDLE;
+    VkBuffer readbackBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory readbackMemory = VK_NULL_HANDLE;
+    void *readbackData = nullptr;
+
+    Job job = {};
+    Job pending = {};
+    bool hasPending = false;
+
+    void start();
+};
+
+// One pool of workers, sized to the machine, for the CPU work of every subsystem (decoding, texel
+// conversion, pipeline compiles, encoding) instead of threads of their own. Jobs may depend on
+// others and are queued once the last of those finished.
+class JobSystem {
+public:
+    struct Job;
+    typedef std::shared_ptr<Job> Handle;
+    struct Job {
+        std::function<void()> work;
+        std::atomic<uint32_t> waitingFor{0};    // unfinished dependencies, +1 while submit() links them
+        std::mutex mutex;                       // guards done and dependents
+        bool done = false;
+        std::vector<Handle> dependents = {};
+        std::exception_ptr error = nullptr;
+    };
+    struct WorkerStats {
+        uint64_t busyNs = 0;
+        uint64_t jobCount = 0;
+        uint64_t stolenCount = 0;   // of jobCount, taken from another worker's deque
+    };
+
+    void create(uint32_t threadCount);      // 0 - one per core
+    void destroy();                         // runs what is queued, then joins
+    uint32_t threadCount() { return static_cast<uint32_t>(this->workers.size()); }
+
+    // work runs on a worker once every job of dependencies finished (threw or not); without
+    // workers it runs right here
+    Handle submit(std::function<void()> work, const std::vector<Handle> &dependencies = {});
+    bool isDone(const Handle &job);
+    // runs queued jobs while waiting, so jobs may wait for others; rethrows what the job threw
+    void wait(const Handle &job);
+    // body over [0, count) in chunks of grain, on the workers and the calling thread
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &body);
+
+    // per worker since create(); busyNs over the wall time is its utilization
+    std::vector<WorkerStats> stats();
+    void report();
+
+private:
+    struct Worker {
+        std::thread thread;
+        std::mutex mutex;                   // guards jobs
+        std::deque<Handle> jobs = {};
+        std::atomic<uint64_t> busyNs{0};
+        std::atomic<uint64_t> jobCount{0};
+        std::atomic<uint64_t> stolenCount{0};
+    };
+    std::vector<std::unique_ptr<Worker>> workers = {};
+    std::atomic<uint32_t> nextWorker{0};    // round robin for jobs from outside the pool
+    std::atomic<uint64_t> queuedCount{0};   // in any of the deques
+    std::mutex sleepMutex;
+    std::condition_variable jobQueued;      // idle workers
+    std::condition_variable progress;       // wait(): a job finished or was queued
+    bool stopping = false;
+    std::chrono::steady_clock::time_point createdAt = {};
+
+    void enqueue(const Handle &job);
+    bool runOne(int32_t self);
+    void execute(const Handle &job, int32_t self, bool stolen);
+    void work(uint32_t index);
+};
+
+class ImageEncoder {
+public:
+    enum Format { PNG, JPEG, RAW };
+    struct Job {
+        std::string path;
+        Format format = PNG;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        bool bgra = false;      // swapchain images are mostly B8G8R8A8
+        std::vector<uint8_t> pixels = {};
+        // instead of pixels, width * height * 4 bytes owned by the pusher (a mapped buffer), swapped
+        // in place for bgra; done is called on the encoding thread once they are not read any more
+        uint8_t *data = nullptr;
+        std::function<void()> done = nullptr;
+    };
+
+    size_t maxPending = 0;      // push() blocks above it, 0 - unbounded
+    std::atomic<uint64_t> busyNs{0};
+    std::atomic<uint64_t> encodedCount{0};
+
+    // every pushed image is encoded as a job of jobs
+    void create(JobSystem *jobs);
+    void destroy();             // flush(), by whoever called create()
+    void flush();               // waits until everything pushed is encoded
+    void push(Job &&job);
+    size_t pending();           // pushed, not encoded yet
+    uint32_t threadCount() { return nullptr == this->jobs ? 0 : this->jobs->threadCount(); }
+
+    static bool parseFormat(const std::string &name, Format &format);
+    static const char *extension(Format format);
+
+private:
+    JobSystem *jobs = nullptr;
+    size_t pendingCount = 0;
+    std::mutex mutex;
+    std::condition_variable jobDone;
+
+    static void encode(Job &job);
+};
+
+class BatchProcessor {
+public:
+    Device *device = nullptr;
+    ImageEncoder *encoder = nullptr;
+    JobSystem *jobs = nullptr;           // decodes the inputs
+
+    std::vector<std::string> inputs = {};
+    std::string outputDir = ".";
+    ImageEncoder::Format format = ImageEncoder::PNG;
+    VkExtent2D maxExtent = {256, 256};   // outputs fit into it, keeping the aspect ratio
+    uint32_t ringSize = 4;               // images in flight between upload and readback
+    // instead of reading the outputs back for the encoder, blit each into layer <input index> of
+    // targetImage (kept in TRANSFER_DST_OPTIMAL, layers at least maxExtent big); sizes go to outputExtents
+    VkImage targetImage = VK_NULL_HANDLE;
+    std::vector<VkExtent2D> outputExtents = {};
+    // optional, where in targetImage an output of the given extent goes instead (an atlas); called
+    // on the run() thread before the blit is recorded, may replace targetImage. false - skip it
+    std::function<bool(size_t index, VkExtent2D extent, uint32_t &layer, VkOffset2D &offset)> placeOutput = nullptr;
+
+    void create();
+    void destroy();
+    void run();
+
+private:
+    struct Decoded {
+        size_t index = 0;
+        stbi_uc *pixels = nullptr;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+    struct Slot {
+        bool inUse = false;
+        size_t index = 0;
+        VkExtent2D srcExtent = {0, 0};
+        VkExtent2D dstExtent = {0, 0};
+        uint32_t mipLevels = 0;
+        uint32_t targetLayer = 0;
+        VkOffset2D targetOffset = {0, 0};
+
+        VkBuffer stagingBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+        VkDeviceSize stagingCapacity = 0;
+        void *stagingData = nullptr;
+
+        VkImage srcImage = VK_NULL_HANDLE;
+        VkDeviceMemory srcMemory = VK_NULL_HANDLE;
+        VkImage dstImage = VK_NULL_HANDLE;
+        VkDeviceMemory dstMemory = VK_NULL_HANDLE;
+
+        VkBuffer readbackBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory readbackMemory = VK_NULL_HANDLE;
+        VkDeviceSize readbackCapacity = 0;
+        void *readbackData = nullptr;
+
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+    };
+
+    std::vector<Slot> slots = {};
+    VkQueryPool timestamps = VK_NULL_HANDLE;
+    float timestampPeriod = 0.0f;
+
+    size_t nextInput = 0;                // the next to submit a decode job for
+    std::queue<Decoded> decoded = {};    // failed ones too, without pixels
+    std::mutex decodedMutex;
+    std::condition_variable decodedAdded;
+    size_t decodesRunning = 0;
+    std::atomic<uint64_t> decodeBusyNs{0};
+    uint64_t gpuBusyNs = 0;
+
+    void submitDecode();
+    void decode(size_t index);
+    bool popDecoded(Decoded &image);
+    void prepareSlot(Slot &slot, const Decoded &image);
+    void destroySlotImages(Slot &slot);
+    void recordSlot(Slot &slot);
+    void collectSlot(Slot &slot);
+    std::string outputPath(size_t index);
+};
+
+class Readback {
+public:
+    Device *device = nullptr;
+    SwapChain *swapchain = nullptr;
+    ImageEncoder *encoder = nullptr;
+
+    uint32_t ringSize = 4;
+    size_t maxQueued = 8;           // frames waiting for the encoders, newer captures are dropped above it
+    std::string outputDir = "captures";
+    ImageEncoder::Format format = ImageEncoder::PNG;
+    bool captureAll = false;        // every frame
+    bool captureNext = false;       // one screenshot
+    uint64_t capturedCount = 0;
+    uint64_t droppedCount = 0;
+
+    void create();
+    void destroy();         // flushes the encoder, it may still read the slots
+    int32_t beginCapture();
+    void submitCopy(int32_t slotId, uint32_t imageId, VkSemaphore signalSemaphore);
+    void poll();
+    void flush();
+
+private:
+    struct Slot {
+        bool inUse = false;
+        bool encoding = false;      // the encoder reads data, guarded by mutex
+        uint64_t frame = 0;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void *data = nullptr;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+    };
+    std::vector<Slot> slots = {};
+    std::mutex mutex;
+    uint32_t next = 0;
+    uint64_t frameNumber = 0;
+    bool supported = true;
+
+    void collect(Slot &slot);
+};
+
 struct PipelineConf {
     VkGraphicsPipelineCreateInfo PipelineCI = {};
     
@@ -227,12 +1161,46 @@ struct PipelineConf {
     VkShaderModule vertShader = VK_NULL_HANDLE;
     VkShaderModule fragShader = VK_NULL_HANDLE;
     std::vector <VkPipelineShaderStageCreateInfo> shaderStages = {};
+
+    // vertex input
+    std::vector<VkVertexInputBindingDescription> vertexBindings = {};
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes = {};
+};
+
+
+// what goes into the push constant range of Pipeline::createPipelineLayout, same for every shader
+struct PushConstants {
+    glm::vec2 viewScale = {1.0f, 1.0f};     // NDC = position * viewScale + viewOffset
+    glm::vec2 viewOffset = {0.0f, 0.0f};
+    uint32_t textureIndex = 0;              // TextureHeap slot of the drawn texture
 };
 
+// interactive zoom and pan, applied in the vertex shader so vertex buffers never change
+class View {
+public:
+    float zoom = 1.0f;
+    glm::vec2 pan = {0.0f, 0.0f};
+    float minZoom = 0.05f;
+    float maxZoom = 256.0f;
+
+    // keeps the point under cursor (NDC) in place
+    void zoomAt(glm::vec2 cursor, float factor);
+    void panBy(glm::vec2 delta);
+    void reset();
+    void write(PushConstants &pushConstants);
+};
 
 class Pipeline {
 public:
+    // which of the shader pairs compiled in by CMake is used
+    enum Shaders {
+        SHADERS_SIMPLE,     // shaders/simple.*.glsl
+        SHADERS_SHEET,      // shaders/sheet.*.glsl, instanced texture array grid
+    };
+
     Device *device = nullptr;
+    Shaders shaders = SHADERS_SIMPLE;
+    std::vector<VkDescriptorSetLayout> setLayouts = {};
 
     VkPipeline pipeline = VK_NULL_HANDLE;
     VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
@@ -241,6 +1209,12 @@ public:
     
     PipelineConf pipelineConfig = {};
 
+    std::atomic<uint32_t> variantsCreated{0};
+    std::atomic<uint32_t> variantsReused{0};
+    std::atomic<uint32_t> variantsInBackground{0};  // of variantsCreated
+    // any thread: a background compile finished, variantAsync would return it now
+    std::function<void()> notify = nullptr;
+
     void createShaderModules();
     void destroyShaderModules();
 
@@ -248,26 +1222,212 @@ public:
     void destroyPipelineLayout();
 
     void writeDefaultPipelineConf(VkExtent2D extent);
+    // before a pipeline is requested for renderPass; passes whose attachments have the same formats
+    // and samples (renderpass, renderpassPartial differ only in load/store ops and layouts) are
+    // compatible and share pipelines
+    void addRenderPass(VkRenderPass renderPass, const std::vector<VkAttachmentDescription> &attachments);
+    // this->pipeline from pipelineConfig
     void createPipeline(VkRenderPass renderPass);
+    // the pipeline for conf with this object's shaders and layout, compiled on the first request
+    // and cached, so switching between draw styles does not compile again
+    VkPipeline variant(const PipelineConf &conf, VkRenderPass renderPass);
+    // never blocks: the cached pipeline, else the compile is submitted to the job system and
+    // fallback is returned until it is done
+    VkPipeline variantAsync(const PipelineConf &conf, VkRenderPass renderPass, VkPipeline fallback);
+    // variantAsync requests compile as jobs, sharing one VkPipelineCache with the main thread
+    void createCompiler(JobSystem *jobs);
+    // compiles that have not started are dropped, the running ones waited for
+    void destroyCompiler();
+    // every variant
     void destroyPipeline();
+
+private:
+    struct CompileJob {
+        std::string key;
+        PipelineConf conf;
+        VkRenderPass renderPass;
+    };
+
+    // variantKey -> pipeline, VK_NULL_HANDLE while it is being compiled
+    std::unordered_map<std::string, VkPipeline> registry = {};
+    // render pass -> the compatibility part of variantKey
+    std::unordered_map<VkRenderPass, std::string> renderPasses = {};
+    std::set<std::string> failed = {};      // background compiles that threw, not retried there
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    JobSystem *jobs = nullptr;
+    std::vector<JobSystem::Handle> compiles = {};
+    std::mutex mutex;
+    std::condition_variable variantCompiled;
+    bool stopping = false;
+
+    std::string variantKey(const PipelineConf &conf, VkRenderPass renderPass);
+    VkPipeline buildPipeline(const PipelineConf &conf, VkRenderPass renderPass);
+    void compile(const CompileJob &job);
+};
+
+// wall clock phases of the start, from whichever thread ran them, printed as a timeline so the
+// overlap of independent work (decode on a worker while Vulkan comes up) shows
+class StartupTimeline {
+public:
+    // t = 0, the calling thread is "main"
+    void start();
+    // any thread; phases may overlap
+    uint32_t begin(const std::string &name);
+    void end(uint32_t phase);
+    // main thread: ends the phase the previous next() began and begins name
+    void next(const std::string &name);
+    // ends the last next() phase, startup is over
+    void finish();
+    void report();
+
+private:
+    struct Phase {
+        std::string name;
+        bool main = true;
+        double startMs = 0.0;
+        double endMs = -1.0;    // < 0 - still running
+    };
+
+    std::mutex mutex;
+    std::vector<Phase> phases = {};
+    std::chrono::steady_clock::time_point origin = {};
+    std::thread::id mainThread = {};
+    int32_t current = -1;
+    double finishMs = 0.0;
+
+    double nowMs();
+};
+
+// decides when the window loop draws: only after something made the frame dirty (input, resize,
+// finished background work, running animations), otherwise it sleeps in SDL_WaitEventTimeout
+class RedrawScheduler {
+public:
+    bool continuous = false;        // draw every iteration, the old busy loop
+    uint32_t idleTimeoutMs = 250;   // upper bound of a sleep, housekeeping (readback polling) runs on wake
+    uint32_t fpsCap = 0;            // 0 - draw as fast as the present mode lets us
+
+    void create();
+    // main thread: the next iteration draws
+    void invalidate();
+    // any thread: wakes the loop up and invalidates (e.g. an asset finished loading)
+    void post();
+    // while > 0 every iteration draws
+    void beginAnimation() { this->animations++; }
+    void endAnimation() { this->animations--; }
+
+    // blocks while there is nothing to draw, false on timeout
+    bool waitEvent(SDL_Event &event);
+    bool isWakeEvent(const SDL_Event &event) { return event.type == this->wakeEventType; }
+    bool needsFrame() { return this->continuous || this->dirty || this->animations > 0; }
+    void framePresented();
+    // the frame would have looked like the last one, it is not drawn
+    void frameSkipped();
+    // idle loop iterations and whole run, then the wake -> present latency percentiles
+    void report();
+
+private:
+    static const uint32_t LATENCY_WINDOW = 4096;    // latest latencies the percentiles are taken over
+    uint32_t wakeEventType = 0;
+    bool dirty = true;
+    int32_t animations = 0;
+    std::chrono::steady_clock::time_point wakeTime = {};
+    bool wakePending = false;
+    std::array<double, LATENCY_WINDOW> latenciesMs = {};   // ring, latencyCount % LATENCY_WINDOW is next
+    uint64_t latencyCount = 0;
+    double latencySumMs = 0.0;      // mean and max are over the whole run
+    double latencyMaxMs = 0.0;
+    std::chrono::steady_clock::time_point nextFrameTime = {};
+
+    std::chrono::steady_clock::time_point startTime = {};
+    double startCpuS = 0.0;
+    double idleWallS = 0.0;
+    double idleCpuS = 0.0;
+    uint64_t frameCount = 0;
+    uint64_t wakeCount = 0;
+};
+
+// Hands finished frames to vkQueuePresentKHR, on the calling thread or on a present thread of
+// its own that takes them from a lock-free single producer / single consumer ring.
+class Presenter {
+public:
+    Device *device = nullptr;
+    bool threaded = false;      // create() starts the present thread
+
+    struct Request {
+        VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+        uint32_t imageId = 0;
+        VkSemaphore wait = VK_NULL_HANDLE;
+        bool incremental = false;   // only rect changed since the last present
+        VkRectLayerKHR rect = {};
+    };
+
+    uint64_t presentCount = 0;
+    double presentMs = 0.0;     // blocked in vkQueuePresentKHR, on whichever thread presents
+    double waitMs = 0.0;        // the main thread waiting in wait() for the present thread
+
+    void create();
+    void destroy();             // presents what is still queued, then joins
+    // threaded: queued, the result is that of an earlier present (see wait()); inline: presented
+    VkResult submit(const Request &request);
+    // until everything submitted was presented, before the next acquire or a swapchain
+    // recreation; the worst result since the last call
+    VkResult wait();
+
+private:
+    static const uint32_t RING_SIZE = 4;
+    std::array<Request, RING_SIZE> ring = {};
+    std::atomic<uint32_t> head{0};          // next to present, written by the present thread
+    std::atomic<uint32_t> tail{0};          // next free, written by submit()
+    std::atomic<uint32_t> presented{0};     // presents finished, compared against tail
+    std::atomic<int32_t> result{VK_SUCCESS};
+
+    std::thread worker;
+    // only for sleeping, frames pass through the ring without it
+    std::mutex mutex;
+    std::condition_variable frameQueued;
+    std::condition_variable framePresented;
+    bool stopping = false;
+
+    bool push(const Request &request);
+    bool pop(Request &request);
+    VkResult present(const Request &request);
+    void work();
 };
 
 class Renderer {
 public:
     Device *device = nullptr;
     SwapChain *swapchain = nullptr;
+    Readback *readback = nullptr;
+    Presenter *presenter = nullptr;     // presents the frames, required unless offscreen
+    TextureHeap *textures = nullptr;    // bound as set 0 before every draw
+    View *view = nullptr;               // pushed every frame, identity if null
     VkPipeline pipeline = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
     VkPipelineBindPoint pipelineBindType;
 
+    // per frame in flight: a transient pool with the one command buffer the frame is recorded into,
+    // the whole pool is reset once the frame's fence has signaled
+    std::vector<VkCommandPool> framePools = {};
     std::vector<VkCommandBuffer> commandBuffers = {};
 
     uint32_t MAX_FRAMES_IN_FLIGHT = 2;
     size_t currentFrame = 0;
 
+    // headless: no acquire/present, images of the swapchain are used round-robin
+    bool offscreen = false;
+    uint32_t nextOffscreenImage = 0;
+
+    // only what changed since an image was last drawn is cleared and redrawn (render area and
+    // scissor), only what changed since the last present is handed to the presentation engine
+    // (VK_KHR_incremental_present); false - frames are drawn and presented whole
+    bool partialRedraw = true;
+    uint64_t drawnPixels = 0;       // inside the render areas
+    uint64_t framePixels = 0;       // whole extents, both summed over the frames
+
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
     std::vector<VkFence> inFlightFences;
-    std::vector<VkFence> imagesInFlight;
     
     void createSemaphoresFences();
     void destroySemaphoresFences();
@@ -275,25 +1435,73 @@ public:
 
     void createCommandBuffers();
     void destroyCommandBuffers();
-    void recordCommandBuffers(Model *model);
+    void swapChainRecreated();
+    // what the render pass draws, the command buffer of the acquired image is recorded every frame
+    void setContents(Model *model);
+    void setContents(ContactSheet *sheet);
+    // into the current frame's command buffer, after resetting its pool
+    void recordCommandBuffer(uint32_t imageId);
     VkResult submitCommandBuffers(const VkCommandBuffer *buffer, uint32_t *imageIndex);
     void drawFrame();
+
+    // pixels of the swapchain extent that have to be redrawn
+    void damage(VkRect2D rect);
+    void damageAll();
+    // false - every image is up to date, a frame would look like the last one
+    bool hasDamage() { return this->presentDamage.extent.width > 0; }
+
+private:
+    std::function<void(VkCommandBuffer commandBuffer, PushConstants &pushConstants)> contents;
+    // bounding rects, an empty extent - nothing; per swapchain image since it was last drawn, and
+    // since the last present
+    std::vector<VkRect2D> imageDamage = {};
+    VkRect2D presentDamage = {};
+    VkExtent2D renderAreaGranularity = {1, 1};
+
+    void resetDamage();
 };
 
 
 
 struct App {
     bool debug = false;
+    bool headless = false;       // no SDL window, no surface, no swapchain
+    uint32_t frameLimit = 0;     // 0 - run until the window is closed
+    bool ingest = false;         // headless: the texture is copied in from shared memory every frame
+    bool grid = false;           // contact sheet of all the given images instead of the model
     SDL_Window *window = nullptr;
     VkSurfaceKHR surface = nullptr;
-    VkExtent2D windowExtent = {0,0}; // width, height
+    VkExtent2D windowExtent = {1280,720}; // width, height
 
     Instance instance{};
     Device device{};
     SwapChain swapchain{};
     Pipeline pipeline{};
     Renderer renderer{};
+    Presenter presenter{};
+    TextureHeap textures{};
+    View view{};
+    RedrawScheduler scheduler{};
+    StartupTimeline startup{};
+    JobSystem jobs{};
+    uint32_t jobThreads = 0;            // workers of jobs, 0 - one per core
+    JobSystem::Handle decoded;          // Model::loadImageSTBI as a job, waited for before the texture is created
+    int decodeResult = 0;
     Model model{};
+    Downscaler downscaler{};
+    Adjuster adjuster{};
+    Adjuster::Params adjustments{};
+    Histogram histogram{};
+    TimelineWaiter waiter{};            // completion of the Adjuster's and the Histogram's jobs
+    Histogram::Stats sourceStats{};     // of the unadjusted image, auto levels are taken from it
+    Histogram::Stats shownStats{};      // of what is drawn, before any downscale
+    bool autoLevels = false;            // applied once the source stats are in
+    bool alphaBlend = false;            // transparent parts over the background instead of opaque
+    bool drawStylePending = false;      // alphaBlend changed, its pipeline is still being compiled
+    ContactSheet sheet{};
+    ImageEncoder encoder{};
+    BatchProcessor batch{};
+    Readback readback{};
 };
 
 
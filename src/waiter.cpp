@@ -0,0 +1,118 @@
+#include "types.hpp"
+#include <cstdint>
+#include <vulkan/vulkan_core.h>
+
+// The Adjuster and the Histogram used to start a thread for every dispatch, only to block in
+// vkWaitSemaphores until it was done and wake the window loop. One thread now waits on all of
+// them at once (VK_SEMAPHORE_WAIT_ANY_BIT) plus a timeline of its own that the host signals when
+// the set of waits changes. Blocking waits stay off the JobSystem's workers.
+
+void TimelineWaiter::create() {
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &timelineInfo;
+    if (VK_SUCCESS != vkCreateSemaphore(this->device->device, &semaphoreInfo, nullptr, &this->wake)) {
+        throw std::runtime_error("failed to create waiter timeline semaphore!");
+    }
+    this->wakeValue = 0;
+    this->stopping = false;
+    this->worker = std::thread(&TimelineWaiter::work, this);
+}
+
+void TimelineWaiter::destroy() {
+    if (!this->worker.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+        this->waits.clear();
+        signalWake();
+    }
+    this->changed.notify_all();
+    this->worker.join();
+    vkDestroySemaphore(this->device->device, this->wake, nullptr);
+    this->wake = VK_NULL_HANDLE;
+}
+
+// mutex held
+void TimelineWaiter::signalWake() {
+    VkSemaphoreSignalInfo signalInfo{};
+    signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO;
+    signalInfo.semaphore = this->wake;
+    signalInfo.value = ++this->wakeValue;
+    vkSignalSemaphore(this->device->device, &signalInfo);
+}
+
+void TimelineWaiter::add(VkSemaphore semaphore, uint64_t value, std::function<void()> callback) {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->waits.push_back({semaphore, value, std::move(callback)});
+        signalWake();
+    }
+    this->changed.notify_all();
+}
+
+void TimelineWaiter::remove(VkSemaphore semaphore) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    for (size_t i = 0; i < this->waits.size(); i++) {
+        if (this->waits[i].semaphore == semaphore) {
+            this->waits.erase(this->waits.begin() + i);
+            i--;
+        }
+    }
+    // a callback taken out before the erase may still be running
+    this->changed.wait(lock, [this]() { return !this->running; });
+}
+
+void TimelineWaiter::work() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    std::vector<VkSemaphore> semaphores = {};
+    std::vector<uint64_t> values = {};
+    std::vector<std::function<void()>> reached = {};
+    while (true) {
+        this->changed.wait(lock, [this]() { return this->stopping || !this->waits.empty(); });
+        if (this->stopping) break;
+
+        // the wake timeline goes first, past the value it has now
+        semaphores.assign(1, this->wake);
+        values.assign(1, this->wakeValue + 1);
+        for (const Wait &wait : this->waits) {
+            semaphores.push_back(wait.semaphore);
+            values.push_back(wait.value);
+        }
+        lock.unlock();
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.flags = VK_SEMAPHORE_WAIT_ANY_BIT;
+        waitInfo.semaphoreCount = static_cast<uint32_t>(semaphores.size());
+        waitInfo.pSemaphores = semaphores.data();
+        waitInfo.pValues = values.data();
+        vkWaitSemaphores(this->device->device, &waitInfo, UINT64_MAX);
+        lock.lock();
+
+        // the waits may have changed meanwhile, each is checked again
+        for (size_t i = 0; i < this->waits.size(); i++) {
+            uint64_t value = 0;
+            vkGetSemaphoreCounterValue(this->device->device, this->waits[i].semaphore, &value);
+            if (value >= this->waits[i].value) {
+                reached.push_back(std::move(this->waits[i].callback));
+                this->waits.erase(this->waits.begin() + i);
+                i--;
+            }
+        }
+        if (reached.empty()) continue;
+        this->callbackCount += reached.size();
+        this->running = true;
+        lock.unlock();
+        for (std::function<void()> &callback : reached) {
+            callback();
+        }
+        reached.clear();
+        lock.lock();
+        this->running = false;
+        this->changed.notify_all();
+    }
+}